@@ -0,0 +1,35 @@
+#!/bin/bash
+# scaling sweep for hw1 on one machine: generate each n once, run every np under mpirun, verify, print keys/s
+# usage: NS="1000000 10000000" NPS="1 2 4 8" KIND=uniform ./bench.sh     (HW1_* knobs are passed through)
+NS=${NS:-"1000 1000000 10000000"}
+NPS=${NPS:-"1 2 4 8"}
+KIND=${KIND:-uniform}
+REPEAT=${REPEAT:-3}
+DIR=${DIR:-/tmp/hw1_bench}
+HERE=$(cd "$(dirname "$0")" && pwd)
+HW1=${HW1:-$HERE/src/hw1}
+MPIRUN=${MPIRUN:-"mpirun --oversubscribe"}
+
+mkdir -p "$DIR"
+[ -x "$DIR/gen_testcase" ] || g++ -O3 -fopenmp "$HERE/gen_testcase.cpp" -o "$DIR/gen_testcase" || exit 1
+[ -x "$DIR/verify" ] || mpicxx -O3 "$HERE/verify.cc" -o "$DIR/verify" || exit 1
+
+printf "%-12s %-8s %-4s %-10s %-14s %s\n" n kind np seconds keys/s check
+for n in $NS; do
+    in=$DIR/$KIND.$n.in out=$DIR/$KIND.$n.out
+    [ -f "$in" ] || "$DIR/gen_testcase" "$n" "$in" "$KIND" > /dev/null || exit 1
+    for np in $NPS; do
+        best=
+        for ((r = 0; r < REPEAT; ++r)); do
+            rm -f "$out"
+            start=$(date +%s.%N)
+            $MPIRUN -np "$np" "$HW1" "$n" "$in" "$out" > /dev/null || exit 1
+            end=$(date +%s.%N)
+            best=$(awk -v a="$start" -v b="$end" -v best="$best" 'BEGIN { t = b - a; if (best == "" || t < best) best = t; print best }')
+        done
+        check=$($MPIRUN -np "$np" "$DIR/verify" "$n" "$in" "$out")
+        awk -v n="$n" -v kind="$KIND" -v np="$np" -v t="$best" -v check="$check" \
+            'BEGIN { printf "%-12s %-8s %-4s %-10.3f %-14.0f %s\n", n, kind, np, t, n / t, check }'
+    done
+    rm -f "$out"
+done
@@ -0,0 +1,38 @@
+#!/bin/bash
+# checkpoint restart check for hw1: kill a run right after save K is committed (HW1_CKPT_KILL), restart it with
+# HW1_RESTART=1, expect it to resume from that very save and verify the output
+# usage: N=1000000 NP=8 KIND=reverse ./ckpt_test.sh     (cases are "every kill", HW1_* knobs are passed through)
+N=${N:-1000000}
+NP=${NP:-8}
+KIND=${KIND:-reverse}
+CASES=${CASES:-"64:0 1:0 1:2 2:2"}
+DIR=${DIR:-/tmp/hw1_ckpt}
+HERE=$(cd "$(dirname "$0")" && pwd)
+HW1=${HW1:-$HERE/src/hw1}
+MPIRUN=${MPIRUN:-"mpirun --oversubscribe"}
+
+mkdir -p "$DIR"
+[ -x "$DIR/gen_testcase" ] || g++ -O3 -fopenmp "$HERE/gen_testcase.cpp" -o "$DIR/gen_testcase" || exit 1
+[ -x "$DIR/verify" ] || mpicxx -O3 "$HERE/verify.cc" -o "$DIR/verify" || exit 1
+
+in=$DIR/$KIND.$N.in out=$DIR/$KIND.$N.out ckpt=$DIR/ckpt.bin
+[ -f "$in" ] || "$DIR/gen_testcase" "$N" "$in" "$KIND" > /dev/null || exit 1
+failed=0
+for c in $CASES; do
+    every=${c%:*} kill=${c#*:}
+    rm -f "$out" "$ckpt"
+    HW1_CKPT=$ckpt HW1_CKPT_EVERY=$every HW1_CKPT_KILL=$kill $MPIRUN -np "$NP" "$HW1" "$N" "$in" "$out" > /dev/null 2>&1
+    if [ $? -eq 0 ]; then
+        echo "every $every kill $kill: the run was not killed"; failed=1; continue
+    fi
+    line=$(HW1_CKPT=$ckpt HW1_CKPT_EVERY=$every HW1_RESTART=1 $MPIRUN -np "$NP" "$HW1" "$N" "$in" "$out" | grep "^\[ckpt\] resuming")
+    check=$($MPIRUN -np "$NP" "$DIR/verify" "$N" "$in" "$out")
+    expect="from save $kill"
+    if [ "${line%"$expect"}" = "$line" ] || [ "${check#OK}" = "$check" ]; then
+        echo "every $every kill $kill: FAILED (${line:-no resume}; $check)"; failed=1
+    else
+        echo "every $every kill $kill: ${line#\[ckpt\] }; $check"
+    fi
+done
+rm -f "$out" "$ckpt"
+exit $failed
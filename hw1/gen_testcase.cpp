@@ -0,0 +1,83 @@
+// synthetic hw1 testcases: n raw floats like the judge's .in files, generated block by block on all
+// OpenMP threads and streamed out, so n can go up to 1e9 without holding the file in memory
+// usage: ./gen_testcase n out.in [uniform|sorted|reverse|nearly|dups|edge|nan] [seed]
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include <omp.h>
+
+const long long BLOCK = 1 << 20; // keys per block, every block has its own generator so the output does not depend on threads
+
+float sorted_key(long long i, long long n) {
+    return (float)(-1e9 + 2e9 * ((double)i / (double)(n > 1 ? n - 1 : 1)));
+}
+
+// infinities, signed zeros, denormals and the extremes (plus NaN with nan = true), mixed with ordinary keys
+float edge_key(std::mt19937_64& gen, std::uniform_real_distribution<float>& uniform, bool nan) {
+    switch (gen() % 10) {
+        case 0: return nan ? std::numeric_limits<float>::quiet_NaN() : 0.0f;
+        case 1: return std::numeric_limits<float>::infinity();
+        case 2: return -std::numeric_limits<float>::infinity();
+        case 3: return -0.0f;
+        case 4: return 0.0f;
+        case 5: return (gen() & 1 ? 1 : -1) * std::numeric_limits<float>::denorm_min();
+        case 6: return (gen() & 1 ? 1 : -1) * std::numeric_limits<float>::max();
+        default: return uniform(gen);
+    }
+}
+
+void fill_block(float* out, long long first, long long count, long long n, const std::string& kind, unsigned seed) {
+    std::mt19937_64 gen(seed * 1000003ull + first / BLOCK);
+    std::uniform_real_distribution<float> uniform(-1e9f, 1e9f);
+    for (long long x = 0; x < count; ++x) {
+        long long i = first + x;
+        if (kind == "sorted") out[x] = sorted_key(i, n);
+        else if (kind == "reverse") out[x] = sorted_key(n - 1 - i, n);
+        else if (kind == "nearly") out[x] = gen() % 100 ? sorted_key(i, n) : uniform(gen); // 1% out of place
+        else if (kind == "dups") out[x] = (float)(gen() % 16) - 8.0f;
+        else if (kind == "edge" || kind == "nan") out[x] = edge_key(gen, uniform, kind == "nan");
+        else out[x] = uniform(gen);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s n out.in [uniform|sorted|reverse|nearly|dups|edge|nan] [seed]\n", argv[0]);
+        return 1;
+    }
+    long long n = std::atoll(argv[1]);
+    std::string kind = argc > 3 ? argv[3] : "uniform";
+    unsigned seed = argc > 4 ? std::atoi(argv[4]) : 1;
+
+    FILE* file = fopen(argv[2], "wb");
+    if (!file) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    // a batch of one block per thread, generated in parallel and written in order
+    int threads = omp_get_max_threads();
+    std::vector<float> batch(BLOCK * threads);
+    for (long long first = 0; first < n; first += BLOCK * threads) {
+        long long batch_count = std::min(BLOCK * threads, n - first);
+        #pragma omp parallel for schedule(static, 1)
+        for (int t = 0; t < threads; ++t) {
+            long long begin = t * BLOCK;
+            if (begin < batch_count)
+                fill_block(batch.data() + begin, first + begin, std::min(BLOCK, batch_count - begin), n, kind, seed);
+        }
+        if (fwrite(batch.data(), sizeof(float), batch_count, file) != (size_t)batch_count) {
+            perror(argv[2]);
+            return 1;
+        }
+    }
+    fclose(file);
+    printf("%lld %s keys -> %s\n", n, kind.c_str(), argv[2]);
+    return 0;
+}
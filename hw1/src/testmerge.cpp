@@ -0,0 +1,288 @@
+// micro-benchmarks for the hw1 merge kernels, build & run with "make testmerge"
+#include <chrono>
+#include <random> // before hw1.cc, its min/max macros break std headers
+#define HW1_NO_MAIN
+#include "hw1.cc"
+
+const int TOTAL = 1 << 24; // keys per benchmark
+const int NUM_RUNS = 5;
+
+// what hw1 did before kway_merge: two runs at a time with the front_merge pointer loop, log(k) passes
+void pairwise_merge(float*& src, float*& tmp, std::vector<int> counts)
+{
+    while (counts.size() > 1)
+    {
+        std::vector<int> next_counts;
+        float *in = src, *out = tmp;
+        for (size_t r = 0; r < counts.size(); r += 2)
+        {
+            int left_count = counts[r], right_count = r + 1 < counts.size() ? counts[r+1] : 0;
+            float *i = in, *j = in + left_count, *k = out;
+            float *const iend = j, *const jend = j + right_count, *const kend = k + left_count + right_count;
+            while (k != kend)
+            {
+                if (j == jend || (i != iend && *i <= *j)) *k++ = *i++;
+                else *k++ = *j++;
+            }
+            in = jend;
+            out = kend;
+            next_counts.push_back(left_count + right_count);
+        }
+        std::swap(src, tmp);
+        counts.swap(next_counts);
+    }
+}
+
+// k sorted runs of random keys laid out back to back
+void make_runs(float* data, std::vector<int>& counts, int k, std::mt19937& gen)
+{
+    std::uniform_real_distribution<float> dist(-1e6f, 1e6f);
+    for (int i = 0; i < TOTAL; ++i) data[i] = dist(gen);
+    counts.assign(k, TOTAL / k);
+    counts[k-1] += TOTAL % k;
+    float* run = data;
+    for (int r = 0; r < k; ++r)
+    {
+        boost::sort::spreadsort::float_sort(run, run + counts[r]);
+        run += counts[r];
+    }
+}
+
+template <typename F>
+double time_it(F&& f)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    f();
+    std::chrono::duration<double> diff = std::chrono::high_resolution_clock::now() - start;
+    return diff.count();
+}
+
+void bench_kway()
+{
+    std::mt19937 gen(42);
+    float* data = new float[TOTAL];
+    float* src = new float[TOTAL];
+    float* tmp = new float[TOTAL];
+    std::vector<int> counts;
+
+    std::cout << "[k-way merge of " << TOTAL << " keys]\n";
+    std::cout << "    k    pairwise(ms)    loser tree(ms)    speedup\n";
+    for (int k : {2, 4, 8, 16, 32, 64, 128})
+    {
+        make_runs(data, counts, k, gen);
+        double pairwise_total = 0, kway_total = 0;
+        for (int i = 0; i < NUM_RUNS; ++i)
+        {
+            std::copy(data, data + TOTAL, src);
+            pairwise_total += time_it([&] { pairwise_merge(src, tmp, counts); });
+
+            std::vector<const float*> runs(k);
+            for (int r = 0, displ = 0; r < k; displ += counts[r++]) runs[r] = data + displ;
+            kway_total += time_it([&] { kway_merge(runs.data(), counts.data(), k, tmp); });
+        }
+        assert(std::equal(src, src + TOTAL, tmp));
+        printf("%5d %15.2f %17.2f %10.2fx\n", k, pairwise_total / NUM_RUNS * 1e3, kway_total / NUM_RUNS * 1e3,
+               pairwise_total / kway_total);
+    }
+
+    delete[] data;
+    delete[] src;
+    delete[] tmp;
+}
+
+// the scalar loops of front_merge/rear_merge, without the dispatch in front of them
+void scalar_front(const float* a, int, const float* b, int nb, float* out, int nout)
+{
+    const float *i = a, *j = b, *const jend = b + nb;
+    for (float *k = out, *const kend = out + nout; k != kend; ++k) *k = (j == jend || *i <= *j) ? *i++ : *j++;
+}
+
+void scalar_rear(const float* a, int na, const float* b, int nb, float* out, int nout)
+{
+    const float *i = a + na - 1, *j = b + nb - 1, *const iend = a - 1;
+    for (float *k = out + nout - 1, *const kend = out - 1; k != kend; --k) *k = (i == iend || *j >= *i) ? *j-- : *i--;
+}
+
+// two sorted halves of either uniform keys or a sorted sequence with 1% of the keys moved at random
+void make_halves(float* a, float* b, int n, bool nearly_sorted, std::mt19937& gen)
+{
+    std::uniform_real_distribution<float> dist(0.f, 2.f * n);
+    for (int x = 0; x < 2 * n; ++x)
+    {
+        float key = nearly_sorted && gen() % 100 ? (float)x : dist(gen);
+        (x < n ? a[x] : b[x - n]) = key;
+    }
+    boost::sort::spreadsort::float_sort(a, a + n);
+    boost::sort::spreadsort::float_sort(b, b + n);
+}
+
+void bench_simd()
+{
+    const int n = TOTAL / 2;
+    std::mt19937 gen(7);
+    float* a = new float[n];
+    float* b = new float[n];
+    float* expect = new float[n];
+    float* out = new float[n];
+
+    typedef void (*Kernel)(const float*, int, const float*, int, float*, int);
+    struct { const char* name; Kernel front, rear; bool ok; } kernels[] = {
+        {"scalar", scalar_front, scalar_rear, true},
+        {"avx2", merge_avx2<false>, merge_avx2<true>, (bool)__builtin_cpu_supports("avx2")},
+        {"avx512", merge_avx512<false>, merge_avx512<true>, (bool)__builtin_cpu_supports("avx512f")},
+    };
+
+    std::cout << "\n[front_merge/rear_merge of 2 x " << n << " keys]\n";
+    std::cout << "    input            kernel    front(ms)    rear(ms)    speedup\n";
+    for (bool nearly_sorted : {false, true})
+    {
+        make_halves(a, b, n, nearly_sorted, gen);
+        double base = 0;
+        for (auto& kernel : kernels)
+        {
+            if (!kernel.ok) continue;
+            double front_total = 0, rear_total = 0;
+            for (int i = 0; i < NUM_RUNS; ++i)
+            {
+                front_total += time_it([&] { kernel.front(a, n, b, n, out, n); });
+                scalar_front(a, n, b, n, expect, n);
+                assert(std::equal(out, out + n, expect));
+                rear_total += time_it([&] { kernel.rear(a, n, b, n, out, n); });
+                scalar_rear(a, n, b, n, expect, n);
+                assert(std::equal(out, out + n, expect));
+            }
+            if (!base) base = front_total + rear_total;
+            printf("    %-16s %-9s %9.2f %11.2f %9.2fx\n", nearly_sorted ? "nearly sorted" : "random", kernel.name,
+                   front_total / NUM_RUNS * 1e3, rear_total / NUM_RUNS * 1e3, base / (front_total + rear_total));
+        }
+    }
+
+    delete[] a;
+    delete[] b;
+    delete[] expect;
+    delete[] out;
+}
+
+// one exchange of a left rank with n keys against a right rank with n keys shifted up by "shift" of the key range:
+// today's path merges all of the partner's keys through buff_arr, HW1_LOWMEM swaps exactly the crossing keys
+// into self_arr's tail and merges in place with lowmem_block(n) keys of scratch
+void bench_inplace()
+{
+    const int n = TOTAL / 2;
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<float> dist(0.f, 1.f);
+    float* left = new float[n];
+    float* right = new float[n];
+    float* self_arr = new float[n];
+    float* partner_arr = new float[n];
+    float* buff_arr = new float[n];
+    int buf_size = lowmem_block(n);
+    float* scratch = new float[buf_size];
+
+    std::cout << "\n[left exchange of 2 x " << n << " keys, scratch " << buf_size << " keys for in-place]\n";
+    std::cout << "    crossing    buffers(ms)    in-place(ms)    speedup\n";
+    for (float shift : {0.99f, 0.9f, 0.5f, 0.f})
+    {
+        for (int x = 0; x < n; ++x)
+        {
+            left[x] = dist(gen);
+            right[x] = dist(gen) + shift;
+        }
+        boost::sort::spreadsort::float_sort(left, left + n);
+        boost::sort::spreadsort::float_sort(right, right + n);
+        int count = 0; // what lowmem_crossing finds, without the MPI round trips
+        while (count < n && left[n - 1 - count] > right[count]) ++count;
+
+        double buffers_total = 0, inplace_total = 0;
+        for (int i = 0; i < NUM_RUNS; ++i)
+        {
+            std::copy(left, left + n, self_arr);
+            std::copy(right, right + n, partner_arr);
+            buffers_total += time_it([&] { front_merge(self_arr, partner_arr, buff_arr, n, n); });
+
+            std::copy(left, left + n - count, buff_arr);
+            std::copy(right, right + count, buff_arr + n - count);
+            inplace_total += time_it([&] { block_merge(buff_arr, buff_arr + n - count, buff_arr + n, scratch, buf_size); });
+            assert(std::equal(buff_arr, buff_arr + n, self_arr));
+        }
+        printf("%11.3f %14.2f %15.2f %9.2fx\n", (double)count / n, buffers_total / NUM_RUNS * 1e3,
+               inplace_total / NUM_RUNS * 1e3, buffers_total / inplace_total);
+    }
+
+    delete[] left;
+    delete[] right;
+    delete[] self_arr;
+    delete[] partner_arr;
+    delete[] buff_arr;
+    delete[] scratch;
+}
+
+// the templated engine: float must resolve to the dedicated kernels (same time as calling them directly),
+// the generic loop instantiated for float shows what a missed overload would cost; then local sort + merge per dtype
+template <typename T>
+void bench_elements(const char* name, std::mt19937& gen)
+{
+    typedef typename KeyOf<T>::type K;
+    const int n = TOTAL / 2;
+    std::uniform_real_distribution<double> dist(-1e9, 1e9);
+    T* a = new T[n];
+    T* b = new T[n];
+    T* buff = new T[n];
+    std::memset(a, 0, sizeof(T) * n);
+    std::memset(b, 0, sizeof(T) * n);
+    for (int x = 0; x < n; ++x)
+    {   // the key leads every element
+        K ka = (K)dist(gen), kb = (K)dist(gen);
+        std::memcpy(&a[x], &ka, sizeof(K));
+        std::memcpy(&b[x], &kb, sizeof(K));
+    }
+    double sort_total = time_it([&] { Sorter<T, std::less<K>>::sort(a, n); Sorter<T, std::less<K>>::sort(b, n); });
+    double merge_total = 0;
+    for (int i = 0; i < NUM_RUNS; ++i)
+        merge_total += time_it([&] { front_merge(a, b, buff, n, n, ByKey<T, std::less<K>>()); std::swap(a, buff); });
+    printf("    %-12s %6zu B %13.2f %13.2f\n", name, sizeof(T), sort_total / 2 * 1e3, merge_total / NUM_RUNS * 1e3);
+    delete[] a;
+    delete[] b;
+    delete[] buff;
+}
+
+void bench_engine()
+{
+    const int n = TOTAL / 2;
+    std::mt19937 gen(5);
+    float* a = new float[n];
+    float* b = new float[n];
+    float* buff = new float[n];
+    make_halves(a, b, n, false, gen);
+
+    double direct = 0, engine = 0, generic = 0;
+    for (int i = 0; i < NUM_RUNS; ++i)
+    {
+        direct += time_it([&] { front_merge(a, b, buff, n, n); std::swap(a, buff); });
+        engine += time_it([&] { front_merge(a, b, buff, n, n, FloatLess()); std::swap(a, buff); });
+        generic += time_it([&] { front_merge<float, std::less<float>>(a, b, buff, n, n, FloatLess()); std::swap(a, buff); });
+    }
+    std::cout << "\n[templated engine, front_merge of 2 x " << n << " floats]\n";
+    printf("    float kernels %.2fms, through the engine %.2fms, generic loop %.2fms\n",
+           direct / NUM_RUNS * 1e3, engine / NUM_RUNS * 1e3, generic / NUM_RUNS * 1e3);
+
+    std::cout << "    dtype        record    sort 2^23(ms)   merge(ms)\n";
+    bench_elements<float>("float", gen);
+    bench_elements<double>("double", gen);
+    bench_elements<int64_t>("int64", gen);
+    bench_elements<Record<float, 8>>("float:8", gen);
+    bench_elements<Record<double, 24>>("double:24", gen);
+
+    delete[] a;
+    delete[] b;
+    delete[] buff;
+}
+
+int main()
+{
+    bench_kway();
+    bench_simd();
+    bench_inplace();
+    bench_engine();
+    return 0;
+}
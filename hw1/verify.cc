@@ -0,0 +1,103 @@
+// parallel replacement for cmp against the expected .out: checks that out is in order and is a permutation
+// of in, without needing the expected file. Each rank streams its slice of both files, NaNs are skipped by
+// the order check (they have no place under <) but counted by the multiset hash like every other bit pattern
+// usage: mpirun -np P ./verify n in out
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <mpi.h>
+
+const int CHUNK = 1 << 22; // keys per read
+
+// order-independent digest of a bag of floats: two sums of differently mixed bit patterns
+struct Digest {
+    uint64_t a = 0, b = 0;
+    void add(float f) {
+        uint32_t u;
+        std::memcpy(&u, &f, sizeof(u));
+        uint64_t x = u + 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        a += x ^ (x >> 31);
+        b += (uint64_t)u * 0xd6e8feb86659fd93ull + (x >> 17);
+    }
+};
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    if (argc < 4) {
+        if (rank == 0) fprintf(stderr, "usage: mpirun -np P %s n in out\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    long long n = std::atoll(argv[1]);
+    long long begin = n * rank / size, end = n * (rank + 1) / size;
+
+    MPI_File in_file, out_file;
+    MPI_File_open(MPI_COMM_WORLD, argv[2], MPI_MODE_RDONLY, MPI_INFO_NULL, &in_file);
+    MPI_File_open(MPI_COMM_WORLD, argv[3], MPI_MODE_RDONLY, MPI_INFO_NULL, &out_file);
+    MPI_Offset in_size, out_size;
+    MPI_File_get_size(in_file, &in_size);
+    MPI_File_get_size(out_file, &out_size);
+
+    Digest in_digest, out_digest;
+    long long disorder = -1; // first out-of-order index seen by this rank
+    float first = NAN, last = NAN; // first and last non-NaN key of the slice, for the checks across ranks
+    std::vector<float> buf(CHUNK);
+    for (long long at = begin; at < end; at += CHUNK) {
+        int count = (int)std::min<long long>(CHUNK, end - at);
+        MPI_File_read_at(in_file, at * sizeof(float), buf.data(), count, MPI_FLOAT, MPI_STATUS_IGNORE);
+        for (int i = 0; i < count; ++i) in_digest.add(buf[i]);
+        MPI_File_read_at(out_file, at * sizeof(float), buf.data(), count, MPI_FLOAT, MPI_STATUS_IGNORE);
+        for (int i = 0; i < count; ++i) {
+            float key = buf[i];
+            out_digest.add(key);
+            if (std::isnan(key)) continue;
+            if (!std::isnan(last) && key < last && disorder < 0) disorder = at + i;
+            if (std::isnan(first)) first = key;
+            last = key;
+        }
+    }
+    MPI_File_close(&in_file);
+    MPI_File_close(&out_file);
+
+    // the last key before this slice comes from the closest earlier rank that had a non-NaN key
+    std::vector<float> firsts(size), lasts(size);
+    MPI_Allgather(&first, 1, MPI_FLOAT, firsts.data(), 1, MPI_FLOAT, MPI_COMM_WORLD);
+    MPI_Allgather(&last, 1, MPI_FLOAT, lasts.data(), 1, MPI_FLOAT, MPI_COMM_WORLD);
+    for (int r = rank - 1; r >= 0 && !std::isnan(first) && disorder < 0; --r)
+        if (!std::isnan(lasts[r])) {
+            if (first < lasts[r]) disorder = begin;
+            break;
+        }
+
+    uint64_t digests[4] = {in_digest.a, in_digest.b, out_digest.a, out_digest.b}, sums[4];
+    long long first_disorder;
+    MPI_Reduce(digests, sums, 4, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+    long long mine = disorder < 0 ? n : disorder;
+    MPI_Reduce(&mine, &first_disorder, 1, MPI_LONG_LONG, MPI_MIN, 0, MPI_COMM_WORLD);
+
+    int ok = 1;
+    if (rank == 0) {
+        if (in_size != n * (MPI_Offset)sizeof(float) || out_size != in_size) {
+            printf("FAIL size: n %lld keys, in %lld bytes, out %lld bytes\n", n, (long long)in_size, (long long)out_size);
+            ok = 0;
+        } else if (first_disorder < n) {
+            printf("FAIL order: key %lld is smaller than the one before it\n", first_disorder);
+            ok = 0;
+        } else if (sums[0] != sums[2] || sums[1] != sums[3]) {
+            printf("FAIL content: out is not a permutation of in\n");
+            ok = 0;
+        } else printf("OK %lld keys\n", n);
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Finalize();
+    return ok ? 0 : 1;
+}
@@ -6,12 +6,35 @@
 //                           -> 62.48 s (with one more x1 vector calculation)
 // Sextuple the parallelism  -> 64.64 s
 //                           -> 63.29 s (with one more x1 vector calculation)
+// Scheduler interface: work stealing over per-thread row ranges (default), atomic guided chunks or the mutex TaskQueue
+// (HW2_SCHED=steal|chunk|mutex), compared by "make testqueue"
+// Tiles (HW2_TILE=64x16): a capped-iteration preview estimates every tile's cost, then tiles go out heaviest first (LPT)
+//   makespan from measured row / tile costs ("make testqueue"), 32x8 tiles vs rows: strict34 1920x1080 at 256 threads
+//   21.3 -> 17.3 ms, at 1024 threads 9.6 -> 4.7 ms; whole set 1600x1600 at 1024 threads 2.9 -> 1.4 ms; equal at <= 64
+//   threads. 64x16 tiles are too coarse for the whole set (one interior tile costs more than a row). HW2_STATS=1
+// Interior fast paths (HW2_INTERIOR=0 turns them off): lanes in the main cardioid or the period-2 bulb are retired
+//   before iterating, and a lane whose orbit returns exactly to the z saved at the last power of two (Brent) is
+//   cycling and retired too. No fused multiply-add anywhere, so every pixel matches hw2seq bit for bit
+//   1 thread, HW2_INTERIOR=0 -> 1: whole set 800x800 228 -> 69 ms, seahorse 600x600 898 -> 540 ms, strict34 960x540
+//   1201 -> 1213 ms (few points in the set, all near the boundary); dropping the FMA costs ~8% (1196 -> 1315 ms)
+// Mariani-Silver (HW2_MS=1): tiles (64x64 or HW2_TILE) go through the scheduler, each computes its border, fills a
+//   rectangle whose border is all iters and whose inside passes inSet, and otherwise splits it along the longer side.
+//   Exact: only pixels the kernel would retire to iters are filled. 1 thread vs rows: seahorse 600x600 348 -> 306 ms
+//   (80% of the pixels iterated, the cardioid edge is in view), whole set 800x800 86 -> 98 ms (93%, the interior
+//   checks already make it cheap), strict34 960x540 1304 -> 1478 ms (100%, scattered pixels), so it stays opt-in
+// SIMD backends: one escapeGroup<V, V_COUNT> kernel for AVX-512, AVX2, SSE2 and scalar, the widest the CPU supports
+//   is picked at run time (HW2_SIMD=avx2 etc. for a narrower one), so the build needs no -march=native
 
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE
 #endif
 #define PNG_NO_SETJMP
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <immintrin.h>
 #include <iostream>
@@ -20,11 +43,30 @@
 #include <png.h>
 #include <sched.h>
 #include <stdexcept>
+#include <string>
+#include <time.h>
 #include <vector>
 
-#define V_COUNT 4
+#pragma GCC optimize("fp-contract=off") // hw2seq is built without -march=native, so it never fuses a * b + c
 
-class TaskQueue
+// vectors interleaved per backend (V_COUNT), best of 1-8 on strict34 480x270 and seahorse 400x400 (ms, 1 thread):
+// avx512 4 -> 349 / 188 (3: 387 / 184, 5: 357 / 208), avx2 3 -> 575 / 220 (2: 648 / 205, 4: 626 / 255),
+// sse2 2 -> 1250 / 321 (4: 1298 / 384), scalar 2 -> 2470 / 486 (4: 2456 / 584)
+#define AVX512_COUNT 4
+#define AVX2_COUNT 3
+#define SSE2_COUNT 2
+#define SCALAR_COUNT 2
+constexpr int MAX_GROUP = std::max({AVX512_COUNT * 8, AVX2_COUNT * 4, SSE2_COUNT * 2, SCALAR_COUNT});
+
+// Hands out [begin, end) ranges of task indices (rows) to the worker threads. Returns false when nothing is left
+class Scheduler
+{
+public:
+    virtual ~Scheduler() {}
+    virtual bool next(int thread_id, int& begin, int& end) = 0;
+};
+
+class TaskQueue : public Scheduler
 {
 private:
     std::vector<int> rows;  // Store row numbers to process
@@ -58,8 +100,376 @@ public:
         pthread_mutex_unlock(&mutex);
         return row;
     }
+
+    bool next(int, int& begin, int& end) override
+    {
+        begin = getNextRow();
+        end = begin + 1;
+        return begin != -1;
+    }
+};
+
+// One atomic counter, no lock. Guided chunks: remaining / (4 * threads) tasks per fetch_add, so the early grabs are
+// big (few atomics on the shared line) and the tail goes out one task at a time; guided = false is always one task,
+// for tasks already sorted by cost
+class ChunkQueue : public Scheduler
+{
+private:
+    std::atomic<int> next_task;
+    int tasks, threads;
+    bool guided;
+
+public:
+    ChunkQueue(int tasks, int threads, bool guided = true) : next_task(0), tasks(tasks), threads(threads), guided(guided) {}
+
+    bool next(int, int& begin, int& end) override
+    {
+        int chunk = guided ? std::max(1, (tasks - next_task.load(std::memory_order_relaxed)) / (4 * threads)) : 1;
+        begin = next_task.fetch_add(chunk, std::memory_order_relaxed);
+        if (begin >= tasks) return false;
+        end = std::min(begin + chunk, tasks);
+        return true;
+    }
+};
+
+// Per-thread deques of task ranges: each thread starts with a contiguous 1 / threads of the tasks and takes 1/8 of
+// what is left in it from the front (at least one task); a thread that runs dry steals the back half of a random
+// victim's range and keeps it as its own. A range is one 64-bit word (begin << 32 | end) only ever changed by CAS,
+// so owner and thieves need no lock, and the owner's CAS stays on its own cache line unless someone is stealing
+class StealQueue : public Scheduler
+{
+private:
+    struct alignas(64) Range
+    {
+        std::atomic<uint64_t> word;
+        uint32_t seed; // victim picker, only touched by the owner
+    };
+    std::unique_ptr<Range[]> ranges;
+    int threads;
+
+    static uint64_t pack(uint32_t begin, uint32_t end) { return (uint64_t)begin << 32 | end; }
+    static uint32_t chunk(uint32_t begin, uint32_t end) { return std::max(1u, (end - begin) / 8); }
+
+public:
+    StealQueue(int tasks, int threads) : ranges(new Range[threads]), threads(threads)
+    {
+        for (int t = 0; t < threads; ++t)
+        {
+            ranges[t].word.store(pack((long long)tasks * t / threads, (long long)tasks * (t + 1) / threads));
+            ranges[t].seed = 2654435761u * (t + 1);
+        }
+    }
+
+    bool next(int thread_id, int& begin, int& end) override
+    {
+        std::atomic<uint64_t>& own = ranges[thread_id].word;
+        uint64_t word = own.load();
+        while ((uint32_t)(word >> 32) < (uint32_t)word)
+        {
+            uint32_t b = word >> 32, e = (uint32_t)word, take = chunk(b, e);
+            if (own.compare_exchange_weak(word, pack(b + take, e)))
+            {
+                begin = b;
+                end = b + take;
+                return true;
+            }
+        }
+
+        // dry: try every other thread once, starting at a random one
+        uint32_t& seed = ranges[thread_id].seed;
+        seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+        for (int k = 0; k < threads; ++k)
+        {
+            int victim = (seed + k) % threads;
+            if (victim == thread_id) continue;
+            std::atomic<uint64_t>& other = ranges[victim].word;
+            uint64_t w = other.load();
+            while ((uint32_t)(w >> 32) < (uint32_t)w)
+            {
+                uint32_t b = w >> 32, e = (uint32_t)w, mid = b + (e - b) / 2; // the last task goes whole
+                if (other.compare_exchange_weak(w, pack(b, mid)))
+                {   // run the first chunk of the loot now, the rest is ours to work on (and to be stolen from)
+                    uint32_t take = chunk(mid, e);
+                    own.store(pack(mid + take, e));
+                    begin = mid;
+                    end = mid + take;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+};
+
+// HW2_SCHED=steal (default) | chunk | mutex
+std::unique_ptr<Scheduler> makeScheduler(int tasks, int threads)
+{
+    const char* name = std::getenv("HW2_SCHED");
+    std::string sched = name ? name : "steal";
+    if (sched == "mutex") return std::make_unique<TaskQueue>(tasks);
+    if (sched == "chunk") return std::make_unique<ChunkQueue>(tasks, threads);
+    return std::make_unique<StealQueue>(tasks, threads);
+}
+
+// SIMD backends for escapeGroup: W doubles per vector D, a lane mask M and per-lane escape counters C. The wide ones
+// are compiled for their own target only and picked at run time, so the binary needs no -march=native
+struct Scalar
+{
+    static const int W = 1;
+    typedef double D;
+    typedef bool M;
+    typedef int C;
+    static D set1(double a) { return a; }
+    static D load(const double* p) { return *p; }
+    static void store(double* p, D a) { *p = a; }
+    static D add(D a, D b) { return a + b; }
+    static D sub(D a, D b) { return a - b; }
+    static D mul(D a, D b) { return a * b; }
+    static M lt(D a, D b) { return a < b; }
+    static M le(D a, D b) { return a <= b; }
+    static M eq(D a, D b) { return a == b; }
+    static M andm(M a, M b) { return a && b; }
+    static M orm(M a, M b) { return a || b; }
+    static M noMask() { return false; }
+    static bool none(M m) { return !m; }
+    static D blend(M m, D a, D b) { return m ? b : a; } // b where m
+    static C count0() { return 0; }
+    static C inc(C c, M m) { return c + m; }
+    static C countSet(C c, M m, int v) { return m ? v : c; }
+    static void countStore(int* p, C c) { *p = c; }
+};
+
+struct Sse2
+{
+    static const int W = 2;
+    typedef __m128d D;
+    typedef __m128d M; // all ones or all zeros per lane
+    typedef __m128i C; // 64-bit counters, a true mask lane is -1
+    static D set1(double a) { return _mm_set1_pd(a); }
+    static D load(const double* p) { return _mm_load_pd(p); }
+    static void store(double* p, D a) { _mm_store_pd(p, a); }
+    static D add(D a, D b) { return _mm_add_pd(a, b); }
+    static D sub(D a, D b) { return _mm_sub_pd(a, b); }
+    static D mul(D a, D b) { return _mm_mul_pd(a, b); }
+    static M lt(D a, D b) { return _mm_cmplt_pd(a, b); }
+    static M le(D a, D b) { return _mm_cmple_pd(a, b); }
+    static M eq(D a, D b) { return _mm_cmpeq_pd(a, b); }
+    static M andm(M a, M b) { return _mm_and_pd(a, b); }
+    static M orm(M a, M b) { return _mm_or_pd(a, b); }
+    static M noMask() { return _mm_setzero_pd(); }
+    static bool none(M m) { return !_mm_movemask_pd(m); }
+    static D blend(M m, D a, D b) { return _mm_or_pd(_mm_and_pd(m, b), _mm_andnot_pd(m, a)); }
+    static C count0() { return _mm_setzero_si128(); }
+    static C inc(C c, M m) { return _mm_sub_epi64(c, _mm_castpd_si128(m)); }
+    static C countSet(C c, M m, int v)
+    {
+        __m128i mi = _mm_castpd_si128(m);
+        return _mm_or_si128(_mm_and_si128(mi, _mm_set1_epi64x(v)), _mm_andnot_si128(mi, c));
+    }
+    static void countStore(int* p, C c)
+    {
+        alignas(16) long long lanes[W];
+        _mm_store_si128((__m128i*)lanes, c);
+        for (int l = 0; l < W; ++l) p[l] = lanes[l];
+    }
+};
+
+// main cardioid: q (q + x - 1/4) <= y^2 / 4 with q = (x - 1/4)^2 + y^2; period-2 bulb: (x + 1)^2 + y^2 <= 1/16
+template <class V>
+typename V::M inSet(typename V::D x0, typename V::D y0)
+{
+    typename V::D y2 = V::mul(y0, y0);
+    typename V::D xq = V::sub(x0, V::set1(0.25));
+    typename V::D q = V::add(V::mul(xq, xq), y2);
+    typename V::D x1 = V::add(x0, V::set1(1.0));
+    return V::orm(V::le(V::mul(q, V::add(q, xq)), V::mul(y2, V::set1(0.25))),
+                  V::le(V::add(V::mul(x1, x1), y2), V::set1(0.0625)));
+}
+
+// escape counts of the V_COUNT * V::W points (xs[l], ys[l]), V_COUNT vectors interleaved to hide the latency of
+// each one's dependency chain. The arithmetic is hw2seq's, one rounding per operation, so every backend gives the
+// same counts. Interior fast paths: lanes in the cardioid or the period-2 bulb are retired up front, and a lane whose
+// orbit returns exactly to the z saved at the last power of two (Brent) is cycling and retired too; a retired lane
+// turns NaN, which drops it from the escape mask, and ends at iters
+template <class V, int V_COUNT>
+void escapeGroup(const double* xs, const double* ys, int* out, int iters, bool interior)
+{
+    typedef typename V::D D;
+    typedef typename V::M M;
+    const int W = V::W;
+    const D vec_two = V::set1(2.0);
+    const D vec_four = V::set1(4.0);
+    const D vec_nan = V::set1(NAN);
+
+    // Local variable array
+    D vec_x0[V_COUNT];
+    D vec_y0[V_COUNT];
+    D vec_x[V_COUNT];
+    D vec_y[V_COUNT];
+    D vec_x2[V_COUNT];
+    D vec_y2[V_COUNT];
+    typename V::C vec_repeats[V_COUNT];
+    M mask[V_COUNT];
+    M retired[V_COUNT]; // lanes known to be in the set
+    alignas(64) double saved_x[V_COUNT * W]; // z at the last save, read every 32nd iteration only
+    alignas(64) double saved_y[V_COUNT * W];
+
+    for (int set = 0; set < V_COUNT; ++set)
+    {
+        vec_x0[set] = V::load(&xs[set * W]);
+        vec_y0[set] = V::load(&ys[set * W]);
+        vec_y[set] = V::set1(0.0);
+        vec_repeats[set] = V::count0();
+        retired[set] = interior ? inSet<V>(vec_x0[set], vec_y0[set]) : V::noMask();
+        vec_x[set] = V::blend(retired[set], V::set1(0.0), vec_nan); // a NaN lane never counts again
+        V::store(&saved_x[set * W], vec_nan); // nothing saved yet
+        V::store(&saved_y[set * W], vec_nan);
+    }
+
+    // Main iteration loop
+    int next_save = 32;
+    for (int iter = 0; iter < iters; ++iter)
+    {
+        bool all_masks_zero = true;
+        for (int set = 0; set < V_COUNT; ++set)
+        {   // Calculate x^2, y^2, length_squared, mask
+            vec_x2[set] = V::mul(vec_x[set], vec_x[set]);
+            vec_y2[set] = V::mul(vec_y[set], vec_y[set]);
+            mask[set] = V::lt(V::add(vec_x2[set], vec_y2[set]), vec_four);
+            all_masks_zero &= V::none(mask[set]);
+        }
+
+        // Early exit if all masks are 0
+        if (all_masks_zero) break;
+
+        // Back on a z seen before: the orbit repeats from here and can never escape. Saves are at multiples of 32,
+        // so the orbit also comes back to the saved z on a multiple of 32 (32 periods later at worst); checking
+        // every 8th iteration cost strict34 7%, every 32nd costs nothing measurable
+        if (interior && !(iter & 31))
+        {
+            for (int set = 0; set < V_COUNT; ++set)
+            {
+                M cycled = V::andm(V::andm(mask[set], V::eq(vec_x[set], V::load(&saved_x[set * W]))),
+                                   V::eq(vec_y[set], V::load(&saved_y[set * W])));
+                retired[set] = V::orm(retired[set], cycled);
+                vec_y[set] = V::blend(cycled, vec_y[set], vec_nan);
+            }
+            if (iter == next_save)
+            {   // Brent: compare against z at the last power of two, the gap doubles until it covers the period
+                for (int set = 0; set < V_COUNT; ++set)
+                {
+                    V::store(&saved_x[set * W], vec_x[set]);
+                    V::store(&saved_y[set * W], vec_y[set]);
+                }
+                next_save <<= 1;
+            }
+        }
+
+        for (int set = 0; set < V_COUNT; ++set)
+        {   // 2xy, then update x and y and count the lanes still inside
+            D vec_2xy = V::mul(V::mul(vec_x[set], vec_y[set]), vec_two);
+            vec_x[set] = V::add(V::sub(vec_x2[set], vec_y2[set]), vec_x0[set]);
+            vec_y[set] = V::add(vec_2xy, vec_y0[set]);
+            vec_repeats[set] = V::inc(vec_repeats[set], mask[set]);
+        }
+    }
+
+    for (int set = 0; set < V_COUNT; ++set)
+        V::countStore(&out[set * W], V::countSet(vec_repeats[set], retired[set], iters));
+}
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+struct Avx2
+{
+    static const int W = 4;
+    typedef __m256d D;
+    typedef __m256d M;
+    typedef __m256i C;
+    static D set1(double a) { return _mm256_set1_pd(a); }
+    static D load(const double* p) { return _mm256_load_pd(p); }
+    static void store(double* p, D a) { _mm256_store_pd(p, a); }
+    static D add(D a, D b) { return _mm256_add_pd(a, b); }
+    static D sub(D a, D b) { return _mm256_sub_pd(a, b); }
+    static D mul(D a, D b) { return _mm256_mul_pd(a, b); }
+    static M lt(D a, D b) { return _mm256_cmp_pd(a, b, _CMP_LT_OS); }
+    static M le(D a, D b) { return _mm256_cmp_pd(a, b, _CMP_LE_OS); }
+    static M eq(D a, D b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    static M andm(M a, M b) { return _mm256_and_pd(a, b); }
+    static M orm(M a, M b) { return _mm256_or_pd(a, b); }
+    static M noMask() { return _mm256_setzero_pd(); }
+    static bool none(M m) { return !_mm256_movemask_pd(m); }
+    static D blend(M m, D a, D b) { return _mm256_blendv_pd(a, b, m); }
+    static C count0() { return _mm256_setzero_si256(); }
+    static C inc(C c, M m) { return _mm256_sub_epi64(c, _mm256_castpd_si256(m)); }
+    static C countSet(C c, M m, int v) { return _mm256_blendv_epi8(c, _mm256_set1_epi64x(v), _mm256_castpd_si256(m)); }
+    static void countStore(int* p, C c)
+    {
+        alignas(32) long long lanes[W];
+        _mm256_store_si256((__m256i*)lanes, c);
+        for (int l = 0; l < W; ++l) p[l] = lanes[l];
+    }
+};
+template Avx2::M inSet<Avx2>(Avx2::D, Avx2::D);
+template void escapeGroup<Avx2, AVX2_COUNT>(const double*, const double*, int*, int, bool);
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512vl")
+struct Avx512
+{
+    static const int W = 8;
+    typedef __m512d D;
+    typedef __mmask8 M;
+    typedef __m256i C; // 32-bit counters, one masked add per iteration
+    static D set1(double a) { return _mm512_set1_pd(a); }
+    static D load(const double* p) { return _mm512_load_pd(p); }
+    static void store(double* p, D a) { _mm512_store_pd(p, a); }
+    static D add(D a, D b) { return _mm512_add_pd(a, b); }
+    static D sub(D a, D b) { return _mm512_sub_pd(a, b); }
+    static D mul(D a, D b) { return _mm512_mul_pd(a, b); }
+    static M lt(D a, D b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OS); }
+    static M le(D a, D b) { return _mm512_cmp_pd_mask(a, b, _CMP_LE_OS); }
+    static M eq(D a, D b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+    static M andm(M a, M b) { return a & b; }
+    static M orm(M a, M b) { return a | b; }
+    static M noMask() { return 0; }
+    static bool none(M m) { return !m; }
+    static D blend(M m, D a, D b) { return _mm512_mask_mov_pd(a, m, b); }
+    static C count0() { return _mm256_setzero_si256(); }
+    static C inc(C c, M m) { return _mm256_mask_add_epi32(c, m, c, _mm256_set1_epi32(1)); }
+    static C countSet(C c, M m, int v) { return _mm256_mask_mov_epi32(c, m, _mm256_set1_epi32(v)); }
+    static void countStore(int* p, C c) { _mm256_storeu_si256((__m256i*)p, c); }
+};
+template Avx512::M inSet<Avx512>(Avx512::D, Avx512::D);
+template void escapeGroup<Avx512, AVX512_COUNT>(const double*, const double*, int*, int, bool);
+#pragma GCC pop_options
+
+typedef void (*EscapeKernel)(const double* xs, const double* ys, int* out, int iters, bool interior);
+
+struct Simd
+{
+    const char* name;
+    int group; // points per escapeGroup call, V_COUNT * W
+    EscapeKernel kernel;
 };
 
+// the widest backend this CPU runs; HW2_SIMD=avx512|avx2|sse2|scalar asks for a narrower one (if supported)
+Simd pickSimd()
+{
+    __builtin_cpu_init();
+    std::vector<Simd> supported;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl"))
+        supported.push_back({"avx512", AVX512_COUNT * Avx512::W, escapeGroup<Avx512, AVX512_COUNT>});
+    if (__builtin_cpu_supports("avx2")) supported.push_back({"avx2", AVX2_COUNT * Avx2::W, escapeGroup<Avx2, AVX2_COUNT>});
+    supported.push_back({"sse2", SSE2_COUNT * Sse2::W, escapeGroup<Sse2, SSE2_COUNT>}); // part of x86-64
+    supported.push_back({"scalar", SCALAR_COUNT, escapeGroup<Scalar, SCALAR_COUNT>});
+    const char* name = std::getenv("HW2_SIMD");
+    for (const Simd& simd : supported)
+        if (name && std::strcmp(name, simd.name) == 0) return simd;
+    return supported.front();
+}
+
 class PNGWriter
 {
 private:
@@ -137,8 +547,25 @@ class MandelbrotGenerator
 private:
     double left, right, lower, upper;
     int width, height, iters, thread_num;
+    bool interior; // cardioid / bulb test and periodicity checking
+    Simd simd;     // kernel for this CPU
     std::unique_ptr<int[]> image;
-    std::unique_ptr<TaskQueue> task_queue;
+    std::unique_ptr<Scheduler> scheduler;
+
+    // tile mode, tile_w = 0 keeps whole rows
+    int tile_w = 0, tile_h = 0, tiles_x = 0, tiles_y = 0;
+    std::vector<double> tile_cost; // preview estimate per tile
+    std::vector<int> order;        // tiles, heaviest first
+    std::unique_ptr<Scheduler> preview;
+    pthread_barrier_t barrier;
+
+    bool mariani = false;          // HW2_MS: tiles are traced by Mariani-Silver instead of computed pixel by pixel
+
+    std::vector<double> busy;      // per-thread CPU seconds, for HW2_STATS
+    std::vector<long long> tasks;
+    std::vector<long long> computed; // pixels iterated, the rest was filled (HW2_MS)
+
+    friend struct TileBench; // testqueue.cpp times single rows and tiles
 
     struct ThreadData
     {
@@ -155,183 +582,240 @@ private:
     }
 
     void compute(int thread_id)
+    {
+        int begin, end;
+        if (!tile_w)
+        {   // Process row ranges dynamically
+            while (scheduler->next(thread_id, begin, end))
+                for (int j = begin; j < end; ++j, ++tasks[thread_id]) computeSpan(j, 0, width);
+        }
+        else if (mariani)
+        {   // the cost of a tile is not known before its border is, so no preview
+            std::vector<int> pixels;
+            while (scheduler->next(thread_id, begin, end))
+                for (int t = begin; t < end; ++t, ++tasks[thread_id]) marianiSilver(t, pixels, computed[thread_id]);
+        }
+        else
+        {   // all threads preview, one sorts, then tiles go out heaviest first
+            while (preview->next(thread_id, begin, end))
+                for (int t = begin; t < end; ++t) tile_cost[t] = previewTile(t);
+            pthread_barrier_wait(&barrier);
+            if (thread_id == 0)
+            {
+                order.resize(tile_cost.size());
+                for (size_t t = 0; t < order.size(); ++t) order[t] = t;
+                std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return tile_cost[a] > tile_cost[b]; });
+            }
+            pthread_barrier_wait(&barrier);
+            while (scheduler->next(thread_id, begin, end))
+                for (int k = begin; k < end; ++k, ++tasks[thread_id]) computeTile(order[k]);
+        }
+        timespec cpu;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+        busy[thread_id] = cpu.tv_sec + cpu.tv_nsec * 1e-9;
+    }
+
+    // escape count of one pixel, capped at cap, the same recurrence as the scalar tail of computeSpan
+    int escape(int i, int j, int cap) const
+    {
+        double x0 = i * ((right - left) / width) + left;
+        double y0 = j * ((upper - lower) / height) + lower;
+        double x = 0, y = 0, length_squared = 0;
+        int repeats = 0;
+        while (repeats < cap && length_squared < 4)
+        {
+            double temp = x * x - y * y + x0;
+            y = 2 * x * y + y0;
+            x = temp;
+            length_squared = x * x + y * y;
+            ++repeats;
+        }
+        return repeats;
+    }
+
+    // 4 x 2 samples per tile at no more than 256 iterations; a sample that hits the cap is taken to be in the
+    // set and to cost the full iters, the others cost what they took
+    double previewTile(int t) const
+    {
+        const int cap = std::min(iters, 256);
+        int x0 = t % tiles_x * tile_w, y0 = t / tiles_x * tile_h;
+        int w = std::min(tile_w, width - x0), h = std::min(tile_h, height - y0);
+        double cost = 0;
+        for (int b = 0; b < 2; ++b)
+            for (int a = 0; a < 4; ++a)
+            {
+                int i = x0 + w * (2 * a + 1) / 8, j = y0 + h * (2 * b + 1) / 4;
+                if (interior && inSet<Scalar>(i * ((right - left) / width) + left, j * ((upper - lower) / height) + lower))
+                    continue; // retired before the first iteration
+                int n = escape(i, j, cap);
+                cost += n == cap ? iters : n;
+            }
+        return (cost + 8) * w * h / 8; // + 1 per pixel for the loop overhead
+    }
+
+    void computeTile(int t)
+    {
+        int x0 = t % tiles_x * tile_w, y0 = t / tiles_x * tile_h;
+        for (int j = y0; j < std::min(y0 + tile_h, height); ++j) computeSpan(j, x0, std::min(x0 + tile_w, width));
+    }
+
+    struct Rect
+    {
+        int x0, y0, x1, y1; // inclusive, the border is computed
+    };
+
+    // interior of r lies in the cardioid or the period-2 bulb, where the kernel retires every lane to iters
+    bool insideSet(const Rect& r) const
     {
         double x_offset = (right - left) / width;
         double y_offset = (upper - lower) / height;
+        for (int y = r.y0 + 1; y < r.y1; ++y)
+            for (int x = r.x0 + 1; x < r.x1; ++x)
+                if (!inSet<Scalar>(x * x_offset + left, y * y_offset + lower)) return false;
+        return true;
+    }
 
-        // Constants for vectorized computation
-        __m512d vec_two = _mm512_set1_pd(2.0);
-        __m512d vec_four = _mm512_set1_pd(4.0);
-        __m512d vec_x_offset = _mm512_set1_pd(x_offset);
-        __m512d vec_left = _mm512_set1_pd(left);
-
-        // Local variable array
-        __m512d vec_x0[V_COUNT];
-        __m512d vec_x[V_COUNT];
-        __m512d vec_y[V_COUNT];
-        __m512d vec_x2[V_COUNT];
-        __m512d vec_y2[V_COUNT];
-        __m512d vec_length_squared[V_COUNT];
-        __m256i vec_repeats[V_COUNT];
-        __mmask8 mask[V_COUNT];
-
-        // Process rows dynamically
-        while (true)
+    // Mariani-Silver on tile t: a rectangle whose border is all iters is filled if inSet holds for every pixel inside
+    // (the value the kernel gives them), anything else is split along the longer side. Equal counts on a border are
+    // not trusted beyond that: a filament thinner than a pixel can slip between two border pixels, so escape bands
+    // and the interior of the minibrots are computed. Level by level, so that the split lines of all rectangles go to
+    // computePixels together and fill whole vector groups
+    void marianiSilver(int t, std::vector<int>& pixels, long long& count)
+    {
+        int x0 = t % tiles_x * tile_w, y0 = t / tiles_x * tile_h;
+        int x1 = std::min(x0 + tile_w, width) - 1, y1 = std::min(y0 + tile_h, height) - 1;
+        pixels.clear();
+        for (int x = x0; x <= x1; ++x) pixels.push_back(y0 * width + x);
+        for (int y = y0 + 1; y <= y1; ++y)
         {
-            int j = task_queue->getNextRow();
-            if (j == -1) break; // No more rows to process
-
-            double y0 = j * y_offset + lower;
-            __m512d vec_y0 = _mm512_set1_pd(y0);
+            pixels.push_back(y * width + x0);
+            if (x1 > x0) pixels.push_back(y * width + x1);
+        }
+        if (y1 > y0)
+            for (int x = x0 + 1; x < x1; ++x) pixels.push_back(y1 * width + x);
 
-            int i;
-            int step = V_COUNT << 3;
-            for (i = 0; i < width - step + 1; i += step)
+        std::vector<Rect> level{{x0, y0, x1, y1}}, next;
+        while (!pixels.empty())
+        {
+            computePixels(pixels.data(), pixels.size());
+            count += pixels.size();
+            pixels.clear();
+            next.clear();
+            for (const Rect& r : level)
             {
-                for (int set = 0; set < V_COUNT; ++set)
-                {   // Calculate starting index for this set
-                    int base = i + (set << 3);
-                    vec_x0[set] = _mm512_fmadd_pd(
-                        _mm512_set_pd(
-                            base+7, base+6, base+5, base+4,
-                            base+3, base+2, base+1, base
-                        ),
-                        vec_x_offset,
-                        vec_left
-                    );
-
-                    // Initialize vectors for all sets
-                    vec_x[set] = _mm512_setzero_pd();
-                    vec_y[set] = _mm512_setzero_pd();
-                    vec_x2[set] = _mm512_setzero_pd();
-                    vec_y2[set] = _mm512_setzero_pd();
-                    vec_length_squared[set] = _mm512_setzero_pd();
-                    vec_repeats[set] = _mm256_setzero_si256();
-                    mask[set] = 0xFF;
+                if (r.x1 - r.x0 < 2 || r.y1 - r.y0 < 2) continue; // all border
+                bool full = interior; // HW2_INTERIOR=0: nothing is known without iterating
+                for (int x = r.x0; x <= r.x1 && full; ++x)
+                    full = image[r.y0 * width + x] == iters && image[r.y1 * width + x] == iters;
+                for (int y = r.y0 + 1; y < r.y1 && full; ++y)
+                    full = image[y * width + r.x0] == iters && image[y * width + r.x1] == iters;
+
+                if (full && insideSet(r))
+                    for (int y = r.y0 + 1; y < r.y1; ++y) std::fill(&image[y * width + r.x0 + 1], &image[y * width + r.x1], iters);
+                else if ((r.x1 - r.x0 - 1) * (r.y1 - r.y0 - 1) <= simd.group)
+                {   // no more pixels than one vector group, cheaper than more borders
+                    for (int y = r.y0 + 1; y < r.y1; ++y)
+                        for (int x = r.x0 + 1; x < r.x1; ++x) pixels.push_back(y * width + x);
                 }
-                
-                // Main iteration loop
-                bool all_masks_zero;
-                for (int iter = 0; iter < iters; ++iter)
+                else if (r.x1 - r.x0 >= r.y1 - r.y0)
                 {
-                    all_masks_zero = true;
-                    // Process all sets
-                    for (int set = 0; set < V_COUNT; ++set)
-                    {
-                        // Calculate x^2, y^2, length_squared, mask
-                        vec_x2[set] = _mm512_mul_pd(vec_x[set], vec_x[set]);
-                        vec_y2[set] = _mm512_mul_pd(vec_y[set], vec_y[set]);
-                        vec_length_squared[set] = _mm512_add_pd(vec_x2[set], vec_y2[set]);
-                        mask[set] = _mm512_cmp_pd_mask(vec_length_squared[set], vec_four, _CMP_LT_OS);
-
-                        // Reduce mask
-                        all_masks_zero &= (mask[set] == 0);
-                    }
-
-                    // Early exit if all masks are 0
-                    if (all_masks_zero) break;
-
-                    for (int set = 0; set < V_COUNT; ++set)
-                    {
-                        // Calculate 2xy
-                        __m512d vec_2xy = _mm512_mul_pd(_mm512_mul_pd(vec_x[set], vec_y[set]), vec_two);
-                        
-                        // Update x and y
-                        vec_x[set] = _mm512_add_pd(_mm512_sub_pd(vec_x2[set], vec_y2[set]), vec_x0[set]);
-                        vec_y[set] = _mm512_add_pd(vec_2xy, vec_y0);
-
-                        // Increment repeat counters
-                        vec_repeats[set] = _mm256_mask_add_epi32(
-                            vec_repeats[set],
-                            mask[set],
-                            vec_repeats[set],
-                            _mm256_set1_epi32(1)
-                        );
-                    }
+                    int xm = (r.x0 + r.x1) / 2;
+                    for (int y = r.y0 + 1; y < r.y1; ++y) pixels.push_back(y * width + xm);
+                    next.push_back({r.x0, r.y0, xm, r.y1});
+                    next.push_back({xm, r.y0, r.x1, r.y1});
                 }
-
-                // Store results for all sets
-                for (int set = 0; set < V_COUNT; ++set)
+                else
                 {
-                    _mm256_storeu_epi32(&image[j * width + i + (set << 3)], vec_repeats[set]);
+                    int ym = (r.y0 + r.y1) / 2;
+                    for (int x = r.x0 + 1; x < r.x1; ++x) pixels.push_back(ym * width + x);
+                    next.push_back({r.x0, r.y0, r.x1, ym});
+                    next.push_back({r.x0, ym, r.x1, r.y1});
                 }
             }
-            // Finish the remaining 0 ~ (V_COUNT * 8)
-            for (; i < width - 7; i += 8)
-            {
-                // First set of 8 values
-                __m512d vec_x0_1 = _mm512_fmadd_pd(
-                    _mm512_set_pd(i+7, i+6, i+5, i+4, i+3, i+2, i+1, i),
-                    vec_x_offset,
-                    vec_left
-                );
-
-                // Initialize vectors for all sets
-                __m512d vec_x_1 = _mm512_setzero_pd();
-                __m512d vec_y_1 = _mm512_setzero_pd();
-                __m512d vec_x2_1 = _mm512_setzero_pd();
-                __m512d vec_y2_1 = _mm512_setzero_pd();
-                __m512d vec_length_squared_1 = _mm512_setzero_pd();
-                __m256i vec_repeats_1 = _mm256_setzero_si256();
-                __mmask8 mask_1 = 0xFF;
-                
-                // Main iteration loop
-                for (int iter = 0; iter < iters; ++iter) {
-                    // Process first set
-                    vec_x2_1 = _mm512_mul_pd(vec_x_1, vec_x_1);
-                    vec_y2_1 = _mm512_mul_pd(vec_y_1, vec_y_1);
-                    vec_length_squared_1 = _mm512_add_pd(vec_x2_1, vec_y2_1);
-                    mask_1 = _mm512_cmp_pd_mask(vec_length_squared_1, vec_four, _CMP_LT_OS);
-
-                    // Early exit if all masks are 0
-                    if (!mask_1) break;
-
-                    // Calculate 2xy for all sets
-                    __m512d vec_2xy_1 = _mm512_mul_pd(_mm512_mul_pd(vec_x_1, vec_y_1), vec_two);
-
-                    // Update x and y for first set
-                    vec_x_1 = _mm512_add_pd(_mm512_sub_pd(vec_x2_1, vec_y2_1), vec_x0_1);
-                    vec_y_1 = _mm512_add_pd(vec_2xy_1, vec_y0);
-
-                    // Increment repeat counters for first set
-                    vec_repeats_1 = _mm256_mask_add_epi32(
-                        vec_repeats_1,
-                        mask_1,
-                        vec_repeats_1,
-                        _mm256_set1_epi32(1)
-                    );
-                }
+            level.swap(next);
+        }
+    }
 
-                // Store results for all sets
-                _mm256_storeu_epi32(&image[j * width + i], vec_repeats_1);
-            }
-            // Finish the remaining
-            for (; i < width; ++i)
+    // n scattered pixels (index j * width + i), simd.group at a time, the last group padded with the last pixel
+    void computePixels(const int* pixel, int n)
+    {
+        double x_offset = (right - left) / width;
+        double y_offset = (upper - lower) / height;
+        alignas(64) double xs[MAX_GROUP];
+        alignas(64) double ys[MAX_GROUP];
+        alignas(64) int out[MAX_GROUP];
+        for (int k = 0; k < n; k += simd.group)
+        {
+            for (int l = 0; l < simd.group; ++l)
             {
-                double x0 = i * x_offset + left;
-				double x = 0;
-				double y = 0;
-				double length_squared = 0;
-				int repeats = 0;
-				while (repeats < iters && length_squared < 4)
-				{
-					double temp = x * x - y * y + x0;
-					y = 2 * x * y + y0;
-					x = temp;
-					length_squared = x * x + y * y;
-					++repeats;
-				}
-				image[j * width + i] = repeats;
+                int p = pixel[std::min(k + l, n - 1)];
+                xs[l] = p % width * x_offset + left;
+                ys[l] = p / width * y_offset + lower;
             }
+            simd.kernel(xs, ys, out, iters, interior);
+            for (int l = 0; l < std::min(simd.group, n - k); ++l) image[pixel[k + l]] = out[l];
+        }
+    }
+
+    // pixels [x_begin, x_end) of row j, the last group padded with the last pixel
+    void computeSpan(int j, int x_begin, int x_end)
+    {
+        double x_offset = (right - left) / width;
+        double y_offset = (upper - lower) / height;
+        alignas(64) double xs[MAX_GROUP];
+        alignas(64) double ys[MAX_GROUP];
+        alignas(64) int out[MAX_GROUP];
+        std::fill(ys, ys + simd.group, j * y_offset + lower);
+        for (int i = x_begin; i < x_end; i += simd.group)
+        {
+            for (int l = 0; l < simd.group; ++l) xs[l] = std::min(i + l, x_end - 1) * x_offset + left;
+            simd.kernel(xs, ys, out, iters, interior);
+            std::copy(out, out + std::min(simd.group, x_end - i), &image[j * width + i]);
         }
     }
 
 public:
     MandelbrotGenerator(double l, double r, double low, double up, int w, int h, int iters, int thread_num)
-        : left(l), right(r), lower(low), upper(up), width(w), height(h), iters(iters), thread_num(thread_num)
+        : left(l), right(r), lower(low), upper(up), width(w), height(h), iters(iters), thread_num(thread_num), simd(pickSimd())
     {
         image = std::make_unique<int[]>(width * height);
-        task_queue = std::make_unique<TaskQueue>(height); // TaskQueue is a Class, which takes in height as parameter in contructor
+        const char* fast = std::getenv("HW2_INTERIOR");
+        interior = !fast || std::atoi(fast) != 0;
+        busy.assign(thread_num, 0);
+        tasks.assign(thread_num, 0);
+        computed.assign(thread_num, 0);
+        const char* ms = std::getenv("HW2_MS");
+        mariani = ms && std::atoi(ms) != 0;
+
+        // HW2_TILE=WxH, e.g. 64x16
+        const char* tile = std::getenv("HW2_TILE");
+        bool tiled = tile && std::sscanf(tile, "%dx%d", &tile_w, &tile_h) == 2 && tile_w > 0 && tile_h > 0;
+        if (mariani)
+        {   // bigger tiles fill more at once, 64x64 still leaves hundreds of tasks at the testcase sizes
+            if (!tiled) tile_w = tile_h = 64;
+            tiles_x = (width + tile_w - 1) / tile_w;
+            tiles_y = (height + tile_h - 1) / tile_h;
+            scheduler = makeScheduler(tiles_x * tiles_y, thread_num);
+        }
+        else if (tiled)
+        {
+            tiles_x = (width + tile_w - 1) / tile_w;
+            tiles_y = (height + tile_h - 1) / tile_h;
+            tile_cost.assign(tiles_x * tiles_y, 0);
+            preview = std::make_unique<ChunkQueue>(tiles_x * tiles_y, thread_num);
+            scheduler = std::make_unique<ChunkQueue>(tiles_x * tiles_y, thread_num, false); // LPT: one tile at a time
+            pthread_barrier_init(&barrier, nullptr, thread_num);
+        }
+        else
+        {
+            tile_w = 0;
+            scheduler = makeScheduler(height, thread_num); // one task per row
+        }
+    }
+
+    ~MandelbrotGenerator()
+    {
+        if (tile_w && !mariani) pthread_barrier_destroy(&barrier);
     }
 
     void generate()
@@ -351,6 +835,27 @@ public:
         {
             pthread_join(threads[i], nullptr);
         }
+        delete[] thread_data;
+
+        // HW2_STATS=1: CPU time per thread, the largest is the makespan the threads would have on their own cores
+        if (std::getenv("HW2_STATS"))
+        {
+            double max_busy = 0, total = 0;
+            for (int i = 0; i < thread_num; ++i)
+            {
+                std::cout << "[sched] thread " << i << " busy " << busy[i] << "s tasks " << tasks[i] << "\n";
+                max_busy = std::max(max_busy, busy[i]);
+                total += busy[i];
+            }
+            std::cout << "[sched] makespan " << max_busy << "s, mean " << total / thread_num << "s, imbalance "
+                      << max_busy / (total / thread_num) << "\n";
+            if (mariani)
+            {
+                long long n = 0;
+                for (long long c : computed) n += c;
+                std::cout << "[ms] iterated " << n << " of " << (long long)width * height << " pixels\n";
+            }
+        }
     }
 
     void saveToPNG(const std::string& filename) const
@@ -360,6 +865,7 @@ public:
     }
 };
 
+#ifndef HW2A_NO_MAIN // testqueue.cpp pulls in the schedulers without main
 int main(int argc, char** argv)
 {
     try
@@ -368,6 +874,7 @@ int main(int argc, char** argv)
         sched_getaffinity(0, sizeof(cpu_set), &cpu_set);
         int thread_num = CPU_COUNT(&cpu_set);
         std::cout << thread_num << " cpus available\n";
+        if (const char* threads = std::getenv("HW2_THREADS")) thread_num = std::max(std::atoi(threads), 1); // experiments
 
         // Validate arguments
         if (argc != 9) throw std::runtime_error("Invalid number of arguments");
@@ -394,4 +901,5 @@ int main(int argc, char** argv)
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
-}
\ No newline at end of file
+}
+#endif
@@ -2,12 +2,24 @@
 // MPI static load (interleaving), vectorization optimized, omp schedule(dynamic, 1) -> (20241101) 84.50 s
 // Quadruple the parallelism -> 70.76 s
 //                           -> 71.46 s (with one more x1 vector calculation)
+// Tiles (HW2_TILE=32x8): ranks share a capped-iteration preview, tiles go to ranks by LPT on the estimates, every
+// rank renders its tiles heaviest first with omp dynamic and they are gathered packed (HW2_STATS=1: CPU per rank)
+//   4 / 16 ranks x 1 thread: interleaved rows are already within 1-4% of even, tiles are not better (seahorse 16
+//   ranks: 1.02 -> 1.20 imbalance, 8 samples per tile misjudge the thin filaments), so rows stay the default
+// Interior fast paths as in hw2a (HW2_INTERIOR=0 turns them off): cardioid / period-2 bulb lanes are retired before
+//   iterating, cycling orbits (z back on the z saved at the last power of two) every 32nd iteration; no fused
+//   multiply-add, so every pixel matches hw2seq bit for bit
+// SIMD backends as in hw2a: the widest of AVX-512, AVX2, SSE2 and scalar is picked at run time (HW2_SIMD), no
+//   -march=native needed
 
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE
 #endif
 #define PNG_NO_SETJMP
 #include <assert.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <immintrin.h>
 #include <iostream>
@@ -18,10 +30,280 @@
 #include <queue>
 #include <sched.h>
 #include <stdexcept>
+#include <string>
+#include <time.h>
 #include <utility> // std::move
 #include <vector>
 
-#define V_COUNT 4
+#pragma GCC optimize("fp-contract=off") // hw2seq is built without -march=native, so it never fuses a * b + c
+
+// vectors interleaved per backend (V_COUNT), best of 1-8 on strict34 480x270 and seahorse 400x400 (ms, 1 thread):
+// avx512 4 -> 349 / 188 (3: 387 / 184, 5: 357 / 208), avx2 3 -> 575 / 220 (2: 648 / 205, 4: 626 / 255),
+// sse2 2 -> 1250 / 321 (4: 1298 / 384), scalar 2 -> 2470 / 486 (4: 2456 / 584)
+#define AVX512_COUNT 4
+#define AVX2_COUNT 3
+#define SSE2_COUNT 2
+#define SCALAR_COUNT 2
+constexpr int MAX_GROUP = std::max({AVX512_COUNT * 8, AVX2_COUNT * 4, SSE2_COUNT * 2, SCALAR_COUNT});
+
+// SIMD backends for escapeGroup: W doubles per vector D, a lane mask M and per-lane escape counters C. The wide ones
+// are compiled for their own target only and picked at run time, so the binary needs no -march=native
+struct Scalar
+{
+    static const int W = 1;
+    typedef double D;
+    typedef bool M;
+    typedef int C;
+    static D set1(double a) { return a; }
+    static D load(const double* p) { return *p; }
+    static void store(double* p, D a) { *p = a; }
+    static D add(D a, D b) { return a + b; }
+    static D sub(D a, D b) { return a - b; }
+    static D mul(D a, D b) { return a * b; }
+    static M lt(D a, D b) { return a < b; }
+    static M le(D a, D b) { return a <= b; }
+    static M eq(D a, D b) { return a == b; }
+    static M andm(M a, M b) { return a && b; }
+    static M orm(M a, M b) { return a || b; }
+    static M noMask() { return false; }
+    static bool none(M m) { return !m; }
+    static D blend(M m, D a, D b) { return m ? b : a; } // b where m
+    static C count0() { return 0; }
+    static C inc(C c, M m) { return c + m; }
+    static C countSet(C c, M m, int v) { return m ? v : c; }
+    static void countStore(int* p, C c) { *p = c; }
+};
+
+struct Sse2
+{
+    static const int W = 2;
+    typedef __m128d D;
+    typedef __m128d M; // all ones or all zeros per lane
+    typedef __m128i C; // 64-bit counters, a true mask lane is -1
+    static D set1(double a) { return _mm_set1_pd(a); }
+    static D load(const double* p) { return _mm_load_pd(p); }
+    static void store(double* p, D a) { _mm_store_pd(p, a); }
+    static D add(D a, D b) { return _mm_add_pd(a, b); }
+    static D sub(D a, D b) { return _mm_sub_pd(a, b); }
+    static D mul(D a, D b) { return _mm_mul_pd(a, b); }
+    static M lt(D a, D b) { return _mm_cmplt_pd(a, b); }
+    static M le(D a, D b) { return _mm_cmple_pd(a, b); }
+    static M eq(D a, D b) { return _mm_cmpeq_pd(a, b); }
+    static M andm(M a, M b) { return _mm_and_pd(a, b); }
+    static M orm(M a, M b) { return _mm_or_pd(a, b); }
+    static M noMask() { return _mm_setzero_pd(); }
+    static bool none(M m) { return !_mm_movemask_pd(m); }
+    static D blend(M m, D a, D b) { return _mm_or_pd(_mm_and_pd(m, b), _mm_andnot_pd(m, a)); }
+    static C count0() { return _mm_setzero_si128(); }
+    static C inc(C c, M m) { return _mm_sub_epi64(c, _mm_castpd_si128(m)); }
+    static C countSet(C c, M m, int v)
+    {
+        __m128i mi = _mm_castpd_si128(m);
+        return _mm_or_si128(_mm_and_si128(mi, _mm_set1_epi64x(v)), _mm_andnot_si128(mi, c));
+    }
+    static void countStore(int* p, C c)
+    {
+        alignas(16) long long lanes[W];
+        _mm_store_si128((__m128i*)lanes, c);
+        for (int l = 0; l < W; ++l) p[l] = lanes[l];
+    }
+};
+
+// main cardioid: q (q + x - 1/4) <= y^2 / 4 with q = (x - 1/4)^2 + y^2; period-2 bulb: (x + 1)^2 + y^2 <= 1/16
+template <class V>
+typename V::M inSet(typename V::D x0, typename V::D y0)
+{
+    typename V::D y2 = V::mul(y0, y0);
+    typename V::D xq = V::sub(x0, V::set1(0.25));
+    typename V::D q = V::add(V::mul(xq, xq), y2);
+    typename V::D x1 = V::add(x0, V::set1(1.0));
+    return V::orm(V::le(V::mul(q, V::add(q, xq)), V::mul(y2, V::set1(0.25))),
+                  V::le(V::add(V::mul(x1, x1), y2), V::set1(0.0625)));
+}
+
+// escape counts of the V_COUNT * V::W points (xs[l], ys[l]), V_COUNT vectors interleaved to hide the latency of
+// each one's dependency chain. The arithmetic is hw2seq's, one rounding per operation, so every backend gives the
+// same counts. Interior fast paths: lanes in the cardioid or the period-2 bulb are retired up front, and a lane whose
+// orbit returns exactly to the z saved at the last power of two (Brent) is cycling and retired too; a retired lane
+// turns NaN, which drops it from the escape mask, and ends at iters
+template <class V, int V_COUNT>
+void escapeGroup(const double* xs, const double* ys, int* out, int iters, bool interior)
+{
+    typedef typename V::D D;
+    typedef typename V::M M;
+    const int W = V::W;
+    const D vec_two = V::set1(2.0);
+    const D vec_four = V::set1(4.0);
+    const D vec_nan = V::set1(NAN);
+
+    // Local variable array
+    D vec_x0[V_COUNT];
+    D vec_y0[V_COUNT];
+    D vec_x[V_COUNT];
+    D vec_y[V_COUNT];
+    D vec_x2[V_COUNT];
+    D vec_y2[V_COUNT];
+    typename V::C vec_repeats[V_COUNT];
+    M mask[V_COUNT];
+    M retired[V_COUNT]; // lanes known to be in the set
+    alignas(64) double saved_x[V_COUNT * W]; // z at the last save, read every 32nd iteration only
+    alignas(64) double saved_y[V_COUNT * W];
+
+    for (int set = 0; set < V_COUNT; ++set)
+    {
+        vec_x0[set] = V::load(&xs[set * W]);
+        vec_y0[set] = V::load(&ys[set * W]);
+        vec_y[set] = V::set1(0.0);
+        vec_repeats[set] = V::count0();
+        retired[set] = interior ? inSet<V>(vec_x0[set], vec_y0[set]) : V::noMask();
+        vec_x[set] = V::blend(retired[set], V::set1(0.0), vec_nan); // a NaN lane never counts again
+        V::store(&saved_x[set * W], vec_nan); // nothing saved yet
+        V::store(&saved_y[set * W], vec_nan);
+    }
+
+    // Main iteration loop
+    int next_save = 32;
+    for (int iter = 0; iter < iters; ++iter)
+    {
+        bool all_masks_zero = true;
+        for (int set = 0; set < V_COUNT; ++set)
+        {   // Calculate x^2, y^2, length_squared, mask
+            vec_x2[set] = V::mul(vec_x[set], vec_x[set]);
+            vec_y2[set] = V::mul(vec_y[set], vec_y[set]);
+            mask[set] = V::lt(V::add(vec_x2[set], vec_y2[set]), vec_four);
+            all_masks_zero &= V::none(mask[set]);
+        }
+
+        // Early exit if all masks are 0
+        if (all_masks_zero) break;
+
+        // Back on a z seen before: the orbit repeats from here and can never escape. Saves are at multiples of 32,
+        // so the orbit also comes back to the saved z on a multiple of 32 (32 periods later at worst); checking
+        // every 8th iteration cost strict34 7%, every 32nd costs nothing measurable
+        if (interior && !(iter & 31))
+        {
+            for (int set = 0; set < V_COUNT; ++set)
+            {
+                M cycled = V::andm(V::andm(mask[set], V::eq(vec_x[set], V::load(&saved_x[set * W]))),
+                                   V::eq(vec_y[set], V::load(&saved_y[set * W])));
+                retired[set] = V::orm(retired[set], cycled);
+                vec_y[set] = V::blend(cycled, vec_y[set], vec_nan);
+            }
+            if (iter == next_save)
+            {   // Brent: compare against z at the last power of two, the gap doubles until it covers the period
+                for (int set = 0; set < V_COUNT; ++set)
+                {
+                    V::store(&saved_x[set * W], vec_x[set]);
+                    V::store(&saved_y[set * W], vec_y[set]);
+                }
+                next_save <<= 1;
+            }
+        }
+
+        for (int set = 0; set < V_COUNT; ++set)
+        {   // 2xy, then update x and y and count the lanes still inside
+            D vec_2xy = V::mul(V::mul(vec_x[set], vec_y[set]), vec_two);
+            vec_x[set] = V::add(V::sub(vec_x2[set], vec_y2[set]), vec_x0[set]);
+            vec_y[set] = V::add(vec_2xy, vec_y0[set]);
+            vec_repeats[set] = V::inc(vec_repeats[set], mask[set]);
+        }
+    }
+
+    for (int set = 0; set < V_COUNT; ++set)
+        V::countStore(&out[set * W], V::countSet(vec_repeats[set], retired[set], iters));
+}
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+struct Avx2
+{
+    static const int W = 4;
+    typedef __m256d D;
+    typedef __m256d M;
+    typedef __m256i C;
+    static D set1(double a) { return _mm256_set1_pd(a); }
+    static D load(const double* p) { return _mm256_load_pd(p); }
+    static void store(double* p, D a) { _mm256_store_pd(p, a); }
+    static D add(D a, D b) { return _mm256_add_pd(a, b); }
+    static D sub(D a, D b) { return _mm256_sub_pd(a, b); }
+    static D mul(D a, D b) { return _mm256_mul_pd(a, b); }
+    static M lt(D a, D b) { return _mm256_cmp_pd(a, b, _CMP_LT_OS); }
+    static M le(D a, D b) { return _mm256_cmp_pd(a, b, _CMP_LE_OS); }
+    static M eq(D a, D b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    static M andm(M a, M b) { return _mm256_and_pd(a, b); }
+    static M orm(M a, M b) { return _mm256_or_pd(a, b); }
+    static M noMask() { return _mm256_setzero_pd(); }
+    static bool none(M m) { return !_mm256_movemask_pd(m); }
+    static D blend(M m, D a, D b) { return _mm256_blendv_pd(a, b, m); }
+    static C count0() { return _mm256_setzero_si256(); }
+    static C inc(C c, M m) { return _mm256_sub_epi64(c, _mm256_castpd_si256(m)); }
+    static C countSet(C c, M m, int v) { return _mm256_blendv_epi8(c, _mm256_set1_epi64x(v), _mm256_castpd_si256(m)); }
+    static void countStore(int* p, C c)
+    {
+        alignas(32) long long lanes[W];
+        _mm256_store_si256((__m256i*)lanes, c);
+        for (int l = 0; l < W; ++l) p[l] = lanes[l];
+    }
+};
+template Avx2::M inSet<Avx2>(Avx2::D, Avx2::D);
+template void escapeGroup<Avx2, AVX2_COUNT>(const double*, const double*, int*, int, bool);
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512vl")
+struct Avx512
+{
+    static const int W = 8;
+    typedef __m512d D;
+    typedef __mmask8 M;
+    typedef __m256i C; // 32-bit counters, one masked add per iteration
+    static D set1(double a) { return _mm512_set1_pd(a); }
+    static D load(const double* p) { return _mm512_load_pd(p); }
+    static void store(double* p, D a) { _mm512_store_pd(p, a); }
+    static D add(D a, D b) { return _mm512_add_pd(a, b); }
+    static D sub(D a, D b) { return _mm512_sub_pd(a, b); }
+    static D mul(D a, D b) { return _mm512_mul_pd(a, b); }
+    static M lt(D a, D b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OS); }
+    static M le(D a, D b) { return _mm512_cmp_pd_mask(a, b, _CMP_LE_OS); }
+    static M eq(D a, D b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+    static M andm(M a, M b) { return a & b; }
+    static M orm(M a, M b) { return a | b; }
+    static M noMask() { return 0; }
+    static bool none(M m) { return !m; }
+    static D blend(M m, D a, D b) { return _mm512_mask_mov_pd(a, m, b); }
+    static C count0() { return _mm256_setzero_si256(); }
+    static C inc(C c, M m) { return _mm256_mask_add_epi32(c, m, c, _mm256_set1_epi32(1)); }
+    static C countSet(C c, M m, int v) { return _mm256_mask_mov_epi32(c, m, _mm256_set1_epi32(v)); }
+    static void countStore(int* p, C c) { _mm256_storeu_si256((__m256i*)p, c); }
+};
+template Avx512::M inSet<Avx512>(Avx512::D, Avx512::D);
+template void escapeGroup<Avx512, AVX512_COUNT>(const double*, const double*, int*, int, bool);
+#pragma GCC pop_options
+
+typedef void (*EscapeKernel)(const double* xs, const double* ys, int* out, int iters, bool interior);
+
+struct Simd
+{
+    const char* name;
+    int group; // points per escapeGroup call, V_COUNT * W
+    EscapeKernel kernel;
+};
+
+// the widest backend this CPU runs; HW2_SIMD=avx512|avx2|sse2|scalar asks for a narrower one (if supported)
+Simd pickSimd()
+{
+    __builtin_cpu_init();
+    std::vector<Simd> supported;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl"))
+        supported.push_back({"avx512", AVX512_COUNT * Avx512::W, escapeGroup<Avx512, AVX512_COUNT>});
+    if (__builtin_cpu_supports("avx2")) supported.push_back({"avx2", AVX2_COUNT * Avx2::W, escapeGroup<Avx2, AVX2_COUNT>});
+    supported.push_back({"sse2", SSE2_COUNT * Sse2::W, escapeGroup<Sse2, SSE2_COUNT>}); // part of x86-64
+    supported.push_back({"scalar", SCALAR_COUNT, escapeGroup<Scalar, SCALAR_COUNT>});
+    const char* name = std::getenv("HW2_SIMD");
+    for (const Simd& simd : supported)
+        if (name && std::strcmp(name, simd.name) == 0) return simd;
+    return supported.front();
+}
 
 class PNGWriter
 {
@@ -114,187 +396,148 @@ private:
     double left, right, lower, upper;
     int width, height, iters;
     int rank, size, num_rows;
+    bool interior; // cardioid / bulb test and periodicity checking
+    Simd simd;     // kernel for this CPU
     std::shared_ptr<int[]> buffer;
 
+    static double cpuNow()
+    {
+        timespec cpu;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+        return cpu.tv_sec + cpu.tv_nsec * 1e-9;
+    }
+
 public:
+    mutable double busy = 0; // CPU seconds of all threads in preview + render, MPI waits left out (HW2_STATS)
+
     MandelbrotGenerator(double l, double r, double low, double up, int w, int h, int iters, int rank, int size, int nr)
-        : left(l), right(r), lower(low), upper(up), width(w), height(h), iters(iters), rank(rank), size(size), num_rows(nr)
+        : left(l), right(r), lower(low), upper(up), width(w), height(h), iters(iters), rank(rank), size(size), num_rows(nr), simd(pickSimd())
     {
         buffer = std::shared_ptr<int[]>(new int[width * num_rows]);
+        const char* fast = std::getenv("HW2_INTERIOR");
+        interior = !fast || std::atoi(fast) != 0;
     }
 
-    // For worker process
-    std::shared_ptr<int[]> generate() const
+    // pixels [x_begin, x_end) of image row global_j, written to out[0, x_end - x_begin); the last group is padded
+    // with the last pixel
+    void computeSpan(int global_j, int x_begin, int x_end, int* out) const
     {
         double x_offset = (right - left) / width;
         double y_offset = (upper - lower) / height;
+        alignas(64) double xs[MAX_GROUP];
+        alignas(64) double ys[MAX_GROUP];
+        alignas(64) int group[MAX_GROUP];
+        std::fill(ys, ys + simd.group, global_j * y_offset + lower);
+        for (int i = x_begin; i < x_end; i += simd.group)
+        {
+            for (int l = 0; l < simd.group; ++l) xs[l] = std::min(i + l, x_end - 1) * x_offset + left;
+            simd.kernel(xs, ys, group, iters, interior);
+            std::copy(group, group + std::min(simd.group, x_end - i), &out[i - x_begin]);
+        }
+    }
 
-        // Constants for vectorized computation
-        // "set1_pd" is broadcasting single value, meaning it has less overhead
-        const __m512d vec_two = _mm512_set1_pd(2.0);
-        const __m512d vec_four = _mm512_set1_pd(4.0);
-        const __m512d vec_x_offset = _mm512_set1_pd(x_offset);
-        const __m512d vec_left = _mm512_set1_pd(left);
+    // escape count of one pixel, capped at cap, the same recurrence as the scalar tail of computeSpan
+    int escape(int i, int j, int cap) const
+    {
+        double x0 = i * ((right - left) / width) + left;
+        double y0 = j * ((upper - lower) / height) + lower;
+        double x = 0, y = 0, length_squared = 0;
+        int repeats = 0;
+        while (repeats < cap && length_squared < 4)
+        {
+            double temp = x * x - y * y + x0;
+            y = 2 * x * y + y0;
+            x = temp;
+            length_squared = x * x + y * y;
+            ++repeats;
+        }
+        return repeats;
+    }
 
+    // For worker process
+    std::shared_ptr<int[]> generate() const
+    {
+        double start = cpuNow();
         #pragma omp parallel for schedule(dynamic, 1)
         for (int global_j = rank; global_j < height; global_j += size)
         {
             int j = (global_j - rank) / size;
-            double y0 = global_j * y_offset + lower;
-            __m512d vec_y0 = _mm512_set1_pd(y0);
-
-            // Local variable array
-            __m512d vec_x0[V_COUNT];
-            __m512d vec_x[V_COUNT];
-            __m512d vec_y[V_COUNT];
-            __m512d vec_x2[V_COUNT];
-            __m512d vec_y2[V_COUNT];
-            __m512d vec_length_squared[V_COUNT];
-            __m256i vec_repeats[V_COUNT];
-            __mmask8 mask[V_COUNT];
-
-            int i;
-            int step = V_COUNT << 3;
-            for (i = 0; i < width - step + 1; i += step)
-            {
-                for (int set = 0; set < V_COUNT; ++set)
-                {   // Calculate starting index for this set
-                    int base = i + (set << 3);
-                    vec_x0[set] = _mm512_fmadd_pd(
-                        _mm512_set_pd(
-                            base+7, base+6, base+5, base+4,
-                            base+3, base+2, base+1, base
-                        ),
-                        vec_x_offset,
-                        vec_left
-                    );
-
-                    // Initialize vectors for all sets
-                    vec_x[set] = _mm512_setzero_pd();
-                    vec_y[set] = _mm512_setzero_pd();
-                    vec_x2[set] = _mm512_setzero_pd();
-                    vec_y2[set] = _mm512_setzero_pd();
-                    vec_length_squared[set] = _mm512_setzero_pd();
-                    vec_repeats[set] = _mm256_setzero_si256();
-                    mask[set] = 0xFF;
-                }
-                
-                // Main iteration loop
-                bool all_masks_zero;
-                for (int iter = 0; iter < iters; ++iter)
-                {
-                    all_masks_zero = true;
-                    // Process all sets
-                    for (int set = 0; set < V_COUNT; ++set)
-                    {
-                        // Calculate x^2, y^2, length_squared, mask
-                        vec_x2[set] = _mm512_mul_pd(vec_x[set], vec_x[set]);
-                        vec_y2[set] = _mm512_mul_pd(vec_y[set], vec_y[set]);
-                        vec_length_squared[set] = _mm512_add_pd(vec_x2[set], vec_y2[set]);
-                        mask[set] = _mm512_cmp_pd_mask(vec_length_squared[set], vec_four, _CMP_LT_OS);
-
-                        // Reduce mask
-                        all_masks_zero &= (mask[set] == 0);
-                    }
-
-                    // Early exit if all masks are 0
-                    if (all_masks_zero) break;
+            computeSpan(global_j, 0, width, &buffer[j * width]);
+        }
+        busy += cpuNow() - start;
 
-                    for (int set = 0; set < V_COUNT; ++set)
-                    {
-                        // Calculate 2xy
-                        __m512d vec_2xy = _mm512_mul_pd(_mm512_mul_pd(vec_x[set], vec_y[set]), vec_two);
-                        
-                        // Update x and y
-                        vec_x[set] = _mm512_add_pd(_mm512_sub_pd(vec_x2[set], vec_y2[set]), vec_x0[set]);
-                        vec_y[set] = _mm512_add_pd(vec_2xy, vec_y0);
-
-                        // Increment repeat counters
-                        vec_repeats[set] = _mm256_mask_add_epi32(
-                            vec_repeats[set],
-                            mask[set],
-                            vec_repeats[set],
-                            _mm256_set1_epi32(1)
-                        );
-                    }
-                }
+        return buffer;
+    }
 
-                // Store results for all sets
-                for (int set = 0; set < V_COUNT; ++set)
-                {
-                    _mm256_storeu_epi32(&buffer[j * width + i + (set << 3)], vec_repeats[set]);
-                }
-            }
-            // Finish the remaining 0 ~ (V_COUNT * 8)
-            // for (; i < width - 7; i += 8)
-            // {
-            //     // First set of 8 values
-            //     __m512d vec_x0_1 = _mm512_fmadd_pd(
-            //         _mm512_set_pd(i+7, i+6, i+5, i+4, i+3, i+2, i+1, i),
-            //         vec_x_offset,
-            //         vec_left
-            //     );
-
-            //     // Initialize vectors for all sets
-            //     __m512d vec_x_1 = _mm512_setzero_pd();
-            //     __m512d vec_y_1 = _mm512_setzero_pd();
-            //     __m512d vec_x2_1 = _mm512_setzero_pd();
-            //     __m512d vec_y2_1 = _mm512_setzero_pd();
-            //     __m512d vec_length_squared_1 = _mm512_setzero_pd();
-            //     __m256i vec_repeats_1 = _mm256_setzero_si256();
-            //     __mmask8 mask_1 = 0xFF;
-                
-            //     // Main iteration loop
-            //     for (int iter = 0; iter < iters; ++iter) {
-            //         // Process first set
-            //         vec_x2_1 = _mm512_mul_pd(vec_x_1, vec_x_1);
-            //         vec_y2_1 = _mm512_mul_pd(vec_y_1, vec_y_1);
-            //         vec_length_squared_1 = _mm512_add_pd(vec_x2_1, vec_y2_1);
-            //         mask_1 = _mm512_cmp_pd_mask(vec_length_squared_1, vec_four, _CMP_LT_OS);
-
-            //         // Early exit if all masks are 0
-            //         if (!mask_1) break;
-
-            //         // Calculate 2xy for all sets
-            //         __m512d vec_2xy_1 = _mm512_mul_pd(_mm512_mul_pd(vec_x_1, vec_y_1), vec_two);
-
-            //         // Update x and y for first set
-            //         vec_x_1 = _mm512_add_pd(_mm512_sub_pd(vec_x2_1, vec_y2_1), vec_x0_1);
-            //         vec_y_1 = _mm512_add_pd(vec_2xy_1, vec_y0);
-
-            //         // Increment repeat counters for first set
-            //         vec_repeats_1 = _mm256_mask_add_epi32(
-            //             vec_repeats_1,
-            //             mask_1,
-            //             vec_repeats_1,
-            //             _mm256_set1_epi32(1)
-            //         );
-            //     }
-
-            //     // Store results for all sets
-            //     _mm256_storeu_epi32(&buffer[j * width + i], vec_repeats_1);
-            // }
-            // Finish the remaining
-            for (int i = width - (width % (V_COUNT << 3)); i < width; ++i)
-            {
-                double x0 = i * x_offset + left;
-                double x = 0;
-                double y = 0;
-                double length_squared = 0;
-                int repeats = 0;
-                while (repeats < iters && length_squared < 4)
+    // HW2_TILE mode: 4 x 2 samples per tile at no more than 256 iterations estimate the tile costs (a sample that
+    // hits the cap counts as a full iters), each rank previews every size-th tile and one Allreduce shares them.
+    // Tiles heaviest first go to the least loaded rank (LPT), so every rank computes the same plan; each rank
+    // renders its own tiles in that order with omp dynamic and returns their pixels packed tile after tile
+    std::vector<int> generateTiles(int tile_w, int tile_h, std::vector<std::vector<int>>& rank_tiles) const
+    {
+        const int cap = std::min(iters, 256);
+        int tiles_x = (width + tile_w - 1) / tile_w, tiles = tiles_x * ((height + tile_h - 1) / tile_h);
+        auto bounds = [&](int t, int& x0, int& y0, int& w, int& h)
+        {
+            x0 = t % tiles_x * tile_w, y0 = t / tiles_x * tile_h;
+            w = std::min(tile_w, width - x0), h = std::min(tile_h, height - y0);
+        };
+
+        std::vector<double> cost(tiles, 0);
+        double start = cpuNow();
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (int t = rank; t < tiles; t += size)
+        {
+            int x0, y0, w, h;
+            bounds(t, x0, y0, w, h);
+            double sum = 0;
+            for (int b = 0; b < 2; ++b)
+                for (int a = 0; a < 4; ++a)
                 {
-                    double temp = x * x - y * y + x0;
-                    y = 2 * x * y + y0;
-                    x = temp;
-                    length_squared = x * x + y * y;
-                    ++repeats;
+                    int i = x0 + w * (2 * a + 1) / 8, j = y0 + h * (2 * b + 1) / 4;
+                    if (interior && inSet<Scalar>(i * ((right - left) / width) + left, j * ((upper - lower) / height) + lower))
+                        continue; // retired before the first iteration
+                    int n = escape(i, j, cap);
+                    sum += n == cap ? iters : n;
                 }
-                buffer[j * width + i] = repeats;
-            }
+            cost[t] = (sum + 8) * w * h / 8; // + 1 per pixel for the loop overhead
+        }
+        busy += cpuNow() - start;
+        MPI_Allreduce(MPI_IN_PLACE, cost.data(), tiles, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+        std::vector<int> order(tiles);
+        for (int t = 0; t < tiles; ++t) order[t] = t;
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return cost[a] > cost[b]; });
+        std::priority_queue<std::pair<double, int>, std::vector<std::pair<double, int>>, std::greater<std::pair<double, int>>> load;
+        for (int r = 0; r < size; ++r) load.push({0.0, r});
+        rank_tiles.assign(size, std::vector<int>());
+        for (int t : order)
+        {
+            std::pair<double, int> least = load.top();
+            load.pop();
+            rank_tiles[least.second].push_back(t);
+            load.push({least.first + cost[t], least.second});
         }
 
-        return buffer;
+        const std::vector<int>& mine = rank_tiles[rank];
+        std::vector<int> offsets(mine.size() + 1, 0);
+        for (size_t k = 0; k < mine.size(); ++k)
+        {
+            int x0, y0, w, h;
+            bounds(mine[k], x0, y0, w, h);
+            offsets[k + 1] = offsets[k] + w * h;
+        }
+        std::vector<int> pixels(offsets.back());
+        start = cpuNow();
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (size_t k = 0; k < mine.size(); ++k)
+        {
+            int x0, y0, w, h;
+            bounds(mine[k], x0, y0, w, h);
+            for (int y = 0; y < h; ++y) computeSpan(y0 + y, x0, x0 + w, &pixels[offsets[k] + y * w]);
+        }
+        busy += cpuNow() - start;
+        return pixels;
     }
 };
 
@@ -335,26 +578,83 @@ int main(int argc, char** argv) {
         int height = std::stoi(argv[8]);
 
         // Divide the work
-        int remainder = height % size;
         int num_rows = (height + size - 1) / size; // Get the ceiling of (height / size)
 
-        // Calculate Mandelbrot set
-        MandelbrotGenerator mandelbrot(left, right, lower, upper, width, height, iters, rank, size, num_rows);
-        std::shared_ptr<int[]> buffer = mandelbrot.generate();
+        // HW2_TILE=WxH, e.g. 32x8
+        int tile_w = 0, tile_h = 0;
+        const char* tile = std::getenv("HW2_TILE");
+        if (!tile || std::sscanf(tile, "%dx%d", &tile_w, &tile_h) != 2 || tile_w <= 0 || tile_h <= 0) tile_w = 0;
 
-        // Prepare for gathering
+        // Calculate Mandelbrot set
+        MandelbrotGenerator mandelbrot(left, right, lower, upper, width, height, iters, rank, size, tile_w ? 0 : num_rows);
         std::unique_ptr<int[]> image;
-        if (rank == 0)
-            image = std::make_unique<int[]>(width * num_rows * size);
+        if (!tile_w)
+        {
+            std::shared_ptr<int[]> buffer = mandelbrot.generate();
+
+            // Prepare for gathering
+            if (rank == 0)
+                image = std::make_unique<int[]>(width * num_rows * size);
+
+            MPI_Gather(buffer.get(), num_rows * width, MPI_INT,
+                       image.get(), num_rows * width, MPI_INT,
+                       0, MPI_COMM_WORLD);
+        }
+        else
+        {
+            std::vector<std::vector<int>> rank_tiles;
+            std::vector<int> pixels = mandelbrot.generateTiles(tile_w, tile_h, rank_tiles);
+
+            // every rank knows the plan, so the tile sizes give the counts and rank 0 can unpack
+            int tiles_x = (width + tile_w - 1) / tile_w;
+            std::vector<int> counts(size, 0), displs(size, 0);
+            for (int r = 0; r < size; ++r)
+            {
+                for (int t : rank_tiles[r])
+                    counts[r] += std::min(tile_w, width - t % tiles_x * tile_w) * std::min(tile_h, height - t / tiles_x * tile_h);
+                if (r) displs[r] = displs[r - 1] + counts[r - 1];
+            }
+            std::vector<int> packed(rank == 0 ? width * height : 0);
+            MPI_Gatherv(pixels.data(), pixels.size(), MPI_INT, packed.data(), counts.data(), displs.data(), MPI_INT,
+                        0, MPI_COMM_WORLD);
+            if (rank == 0)
+            {
+                image = std::make_unique<int[]>(width * height);
+                const int* src = packed.data();
+                for (int r = 0; r < size; ++r)
+                    for (int t : rank_tiles[r])
+                    {
+                        int x0 = t % tiles_x * tile_w, y0 = t / tiles_x * tile_h;
+                        int w = std::min(tile_w, width - x0), h = std::min(tile_h, height - y0);
+                        for (int y = 0; y < h; ++y, src += w) std::copy(src, src + w, &image[(y0 + y) * width + x0]);
+                    }
+            }
+            num_rows = height; // rows in plain order for the writer
+        }
+
+        // HW2_STATS=1: compute CPU seconds of every rank (all its threads), the largest is the makespan on dedicated nodes
+        if (std::getenv("HW2_STATS"))
+        {
+            std::vector<double> all(size);
+            MPI_Gather(&mandelbrot.busy, 1, MPI_DOUBLE, all.data(), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+            if (rank == 0)
+            {
+                double max_busy = 0, total = 0;
+                for (int r = 0; r < size; ++r)
+                {
+                    std::cout << "[sched] rank " << r << " busy " << all[r] << "s\n";
+                    max_busy = std::max(max_busy, all[r]);
+                    total += all[r];
+                }
+                std::cout << "[sched] makespan " << max_busy << "s, mean " << total / size << "s, imbalance "
+                          << max_busy / (total / size) << "\n";
+            }
+        }
 
-        MPI_Gather(buffer.get(), num_rows * width, MPI_INT,
-                   image.get(), num_rows * width, MPI_INT,
-                   0, MPI_COMM_WORLD);
-        
         // Write to PNG
         if (rank == 0)
         {
-            PNGWriter writer(filename, iters, width, height, image.get(), num_rows, size);
+            PNGWriter writer(filename, iters, width, height, image.get(), num_rows, tile_w ? 1 : size);
             writer.write();
         }
         MPI_Finalize();
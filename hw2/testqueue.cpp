@@ -0,0 +1,199 @@
+// scheduler benchmark for hw2a: the mutex TaskQueue against ChunkQueue and StealQueue, build & run with "make testqueue"
+// every thread times each next() call (lock / atomic contention) and when it ran dry (tail = last - first finish);
+// then the makespan of row vs tile (LPT) scheduling from the measured cost of every row and tile
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <queue>
+#define HW2A_NO_MAIN
+#include "src/hw2a_v11(final_ver).cc"
+
+const int TASKS = 1 << 15; // rows
+const int NUM_RUNS = 5;
+
+struct Worker
+{
+    Scheduler* scheduler;
+    const std::vector<int>* cost; // spin iterations per task
+    std::vector<int>* taken;      // how often each task was handed out, must end up all 1
+    int thread_id;
+    long long grabs = 0;
+    double grab_time = 0, max_grab = 0, finish = 0;
+    std::chrono::high_resolution_clock::time_point start;
+};
+
+double since(std::chrono::high_resolution_clock::time_point start)
+{
+    std::chrono::duration<double> diff = std::chrono::high_resolution_clock::now() - start;
+    return diff.count();
+}
+
+void* work(void* arg)
+{
+    Worker* w = static_cast<Worker*>(arg);
+    int begin, end;
+    while (true)
+    {
+        auto before = std::chrono::high_resolution_clock::now();
+        bool got = w->scheduler->next(w->thread_id, begin, end);
+        double t = since(before);
+        w->grab_time += t;
+        w->max_grab = std::max(w->max_grab, t);
+        if (!got) break;
+        w->grabs += 1;
+        for (int j = begin; j < end; ++j)
+        {
+            __atomic_fetch_add(&(*w->taken)[j], 1, __ATOMIC_RELAXED);
+            volatile double x = 0;
+            for (int k = 0; k < (*w->cost)[j]; ++k) x = x * 0.5 + 1;
+        }
+    }
+    w->finish = since(w->start);
+    return nullptr;
+}
+
+// cheap: every row costs the same few spins, so next() itself is the work. skewed: a band of rows in the middle
+// costs up to 100x its neighbours, like rows through the interior of the set
+std::vector<int> make_cost(bool skewed)
+{
+    std::vector<int> cost(TASKS, 20);
+    if (skewed)
+        for (int j = 0; j < TASKS; ++j)
+        {
+            double d = (j - TASKS / 2) / (TASKS / 16.0);
+            cost[j] = 20 + (int)(2000 * std::exp(-d * d));
+        }
+    return cost;
+}
+
+void bench(const char* workload, const std::vector<int>& cost)
+{
+    printf("\n[%s rows, %d tasks]\n", workload, TASKS);
+    printf("  threads  scheduler   makespan(ms)   grabs   ns/grab   max grab(us)   tail(ms)\n");
+    for (int threads : {1, 2, 4, 8, 16, 32})
+        for (const char* name : {"mutex", "chunk", "steal"})
+        {
+            double makespan = 0, grab_time = 0, max_grab = 0, tail = 0;
+            long long grabs = 0;
+            for (int run = 0; run < NUM_RUNS; ++run)
+            {
+                setenv("HW2_SCHED", name, 1);
+                std::unique_ptr<Scheduler> scheduler = makeScheduler(TASKS, threads);
+                std::vector<int> taken(TASKS, 0);
+                std::vector<Worker> workers(threads);
+                std::vector<pthread_t> ids(threads);
+                auto start = std::chrono::high_resolution_clock::now();
+                for (int t = 0; t < threads; ++t)
+                {
+                    workers[t].scheduler = scheduler.get();
+                    workers[t].cost = &cost;
+                    workers[t].taken = &taken;
+                    workers[t].thread_id = t;
+                    workers[t].start = start;
+                    pthread_create(&ids[t], nullptr, work, &workers[t]);
+                }
+                for (int t = 0; t < threads; ++t) pthread_join(ids[t], nullptr);
+                makespan += since(start);
+
+                double first = 1e30, last = 0;
+                for (const Worker& w : workers)
+                {
+                    grabs += w.grabs;
+                    grab_time += w.grab_time;
+                    max_grab = std::max(max_grab, w.max_grab);
+                    first = std::min(first, w.finish);
+                    last = std::max(last, w.finish);
+                }
+                tail += last - first;
+                for (int j = 0; j < TASKS; ++j) assert(taken[j] == 1);
+            }
+            printf("%9d  %-9s %14.2f %7lld %9.0f %14.1f %10.2f\n", threads, name, makespan / NUM_RUNS * 1e3,
+                   grabs / NUM_RUNS, grab_time / grabs * 1e9, max_grab * 1e6, tail / NUM_RUNS * 1e3);
+        }
+}
+
+// makespan of list scheduling: every task in the given order goes to the thread that frees up first, which is
+// what the dynamic schedulers do when the grab itself costs nothing
+double list_makespan(const std::vector<double>& cost, const std::vector<int>& order, int threads)
+{
+    std::priority_queue<double, std::vector<double>, std::greater<double>> free_at;
+    for (int t = 0; t < threads; ++t) free_at.push(0);
+    double makespan = 0;
+    for (int task : order)
+    {
+        double done = free_at.top() + cost[task];
+        free_at.pop();
+        free_at.push(done);
+        makespan = std::max(makespan, done);
+    }
+    return makespan;
+}
+
+// CPU time of this thread, so a task is not charged for the time the OS had someone else on the core
+double cpu_now()
+{
+    timespec cpu;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    return cpu.tv_sec + cpu.tv_nsec * 1e-9;
+}
+
+// one thread renders every row, then every tile, each timed on its own; the preview is timed as a whole and
+// split evenly over the threads, since its tiles are tiny and uniform
+struct TileBench
+{
+    static void run(const char* name, const char* tile, int iters, double left, double right, double lower, double upper, int width, int height)
+    {
+        setenv("HW2_TILE", tile, 1);
+        MandelbrotGenerator gen(left, right, lower, upper, width, height, iters, 1);
+        unsetenv("HW2_TILE");
+        int tiles = gen.tiles_x * gen.tiles_y;
+
+        std::vector<double> row_cost(height), tile_cost(tiles);
+        std::vector<int> rows(height), in_order(tiles), lpt(tiles);
+        for (int j = 0; j < height; ++j)
+        {
+            double start = cpu_now();
+            gen.computeSpan(j, 0, width);
+            row_cost[j] = cpu_now() - start;
+            rows[j] = j;
+        }
+        double preview = cpu_now();
+        for (int t = 0; t < tiles; ++t) gen.tile_cost[t] = gen.previewTile(t);
+        preview = cpu_now() - preview;
+        for (int t = 0; t < tiles; ++t)
+        {
+            double start = cpu_now();
+            gen.computeTile(t);
+            tile_cost[t] = cpu_now() - start;
+            in_order[t] = lpt[t] = t;
+        }
+        std::stable_sort(lpt.begin(), lpt.end(), [&](int a, int b) { return gen.tile_cost[a] > gen.tile_cost[b]; });
+
+        double total = 0;
+        for (double c : row_cost) total += c;
+        printf("\n[%s: %d iters, %dx%d, %d rows, %d %s tiles, %.2fs of work, preview %.1fms]\n", name, iters, width,
+               height, height, tiles, tile, total, preview * 1e3);
+        printf("  threads    ideal(ms)    rows(ms)    tiles(ms)    LPT tiles + preview(ms)    rows / LPT\n");
+        for (int threads : {16, 64, 256, 1024})
+        {
+            double by_rows = list_makespan(row_cost, rows, threads);
+            double by_lpt = list_makespan(tile_cost, lpt, threads) + preview / threads;
+            printf("%9d %12.2f %11.2f %12.2f %26.2f %12.2fx\n", threads, total / threads * 1e3, by_rows * 1e3,
+                   list_makespan(tile_cost, in_order, threads) * 1e3, by_lpt * 1e3, by_rows / by_lpt);
+        }
+    }
+};
+
+int main()
+{
+    bench("cheap", make_cost(false));
+    bench("skewed", make_cost(true));
+    for (const char* tile : {"64x16", "32x8"})
+    {
+        TileBench::run("strict34 zoom", tile, 10000, -0.5506164691618783, -0.5506164628264113, 0.6273445437118131,
+                       0.6273445403522527, 1920, 1080);
+        TileBench::run("whole set", tile, 10000, -2, 2, -2, 2, 1600, 1600);
+        TileBench::run("seahorse valley", tile, 20000, -0.7530, -0.7390, 0.0950, 0.1090, 1200, 1200);
+    }
+    return 0;
+}